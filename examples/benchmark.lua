@@ -0,0 +1,235 @@
+----------------------------------------------------------------------------------------------------
+--[[
+     This example measures the performance of the audio processing without sound hardware
+     by rendering synthetic processing graphs on an offline stream.
+
+     Usage: lua benchmark.lua [cycles [routes [workerThreads [bufferFrames]]]]
+
+     For each graph shape the distribution of the process cycle times is printed.
+     Additionally the latency of connecting and disconnecting routes (i.e. registering
+     and unregistering processors) is measured. If the package lua-auproc is available,
+     also the clearing of bypassed processor outputs and the throughput of MIDI events 
+     are measured.
+
+     All results are printed as one JSON object per line to allow comparing the results
+     of different builds by other tools.
+--]]
+----------------------------------------------------------------------------------------------------
+
+local lrtaudio = require("lrtaudio")
+
+local hasAuproc, auproc = pcall(require, "auproc")   -- https://github.com/osch/lua-auproc
+local hasMtmsg,  mtmsg  = pcall(require, "mtmsg")    -- https://github.com/osch/lua-mtmsg
+local hasCarray, carray = pcall(require, "carray")   -- https://github.com/osch/lua-carray
+
+----------------------------------------------------------------------------------------------------
+
+local cycles        = tonumber(arg[1]) or 10000
+local routeCount    = tonumber(arg[2]) or 64
+local workerThreads = tonumber(arg[3]) or 0
+local bufferFrames  = tonumber(arg[4]) or 128
+
+local format = string.format
+local clock  = os.clock
+
+----------------------------------------------------------------------------------------------------
+
+local function toJson(t)
+    local keys = {}
+    for k in pairs(t) do keys[#keys + 1] = k end
+    table.sort(keys)
+    local fields = {}
+    for _, k in ipairs(keys) do
+        local v = t[k]
+        if type(v) == "number" then
+            v = (math.type and math.type(v) == "integer") and tostring(v) or format("%.9g", v)
+        elseif type(v) == "boolean" then
+            v = tostring(v)
+        else
+            v = format("%q", tostring(v))
+        end
+        fields[#fields + 1] = format("%q:%s", k, v)
+    end
+    return "{"..table.concat(fields, ",").."}"
+end
+
+local function emit(benchmark, result)
+    result.benchmark     = benchmark
+    result.routes        = routeCount
+    result.workerThreads = workerThreads
+    result.bufferFrames  = bufferFrames
+    print(toJson(result))
+    io.stdout:flush()
+end
+
+----------------------------------------------------------------------------------------------------
+
+local function openController(inputChannels, outputChannels)
+    local controller = lrtaudio.new()
+    controller:openStream { offline        = true,
+                            inputChannels  = inputChannels,
+                            outputChannels = outputChannels,
+                            bufferFrames   = bufferFrames,
+                            workerThreads  = workerThreads }
+    return controller
+end
+
+----------------------------------------------------------------------------------------------------
+
+local function measureCycles(benchmark, controller)
+    local nframes = controller:getStreamBufferFrames()
+    controller:renderFrames(nframes * 100) -- warm up
+    controller:enableProcessorStats(true)
+    controller:getProcessorStats(true)
+    local t0 = clock()
+    local rendered = controller:renderFrames(nframes * cycles)
+    local t1 = clock()
+    local stats = controller:getProcessorStats(true).cycle
+    controller:enableProcessorStats(false)
+    emit(benchmark, { cycles   = stats.count,
+                      cpuTime  = t1 - t0,
+                      realtime = rendered / controller:getStreamSampleRate() / (t1 - t0),
+                      min      = stats.min,
+                      mean     = stats.mean,
+                      p50      = stats.p50,
+                      p90      = stats.p90,
+                      p99      = stats.p99,
+                      max      = stats.max,
+                      load     = stats.load,
+                      maxLoad  = stats.maxLoad })
+end
+
+----------------------------------------------------------------------------------------------------
+-- chain: input -> buf1 -> buf2 -> ... -> bufN -> output
+--        every route depends on the previous one, no parallel processing possible.
+
+do
+    local controller = openController(1, 1)
+    local source     = controller:getStreamInput(1)
+    for i = 1, routeCount do
+        local buffer = controller:newStreamBuffer()
+        controller:connect(source, buffer)
+        source = buffer
+    end
+    controller:connect(source, controller:getStreamOutput(1))
+    measureCycles("chain", controller)
+    controller:closeStream()
+end
+
+----------------------------------------------------------------------------------------------------
+-- fanout: input -> buf1, input -> buf2, ..., input -> bufN, each bufI -> output I
+--         all routes are independent, stream buffers refer to the input data.
+
+do
+    local controller = openController(1, routeCount)
+    local input      = controller:getStreamInput(1)
+    for i = 1, routeCount do
+        local buffer = controller:newStreamBuffer()
+        controller:connect(input, buffer)
+        controller:connect(buffer, controller:getStreamOutput(i))
+    end
+    measureCycles("fanout", controller)
+    controller:closeStream()
+end
+
+----------------------------------------------------------------------------------------------------
+-- fanin: input I -> output 1 for all inputs, i.e. the output is a sum target that has to
+--        be cleared and accumulated in each process cycle.
+
+do
+    local controller = openController(routeCount, 1)
+    local output     = controller:getStreamOutput(1)
+    for i = 1, routeCount do
+        controller:connect(controller:getStreamInput(i), output)
+    end
+    measureCycles("fanin", controller)
+    controller:closeStream()
+end
+
+----------------------------------------------------------------------------------------------------
+-- clear: input I -> auproc mixer I -> output I, with the budget for the process cycle set 
+--        to a minimal value, i.e. nearly all mixers are bypassed and only their outputs are
+--        cleared. Routes cannot be used here since they are never bypassed.
+
+if hasAuproc and hasMtmsg then
+    local controller = openController(routeCount, routeCount)
+    local mixers     = {}
+    for i = 1, routeCount do
+        mixers[i] = auproc.new_audio_mixer(controller:getStreamInput(i), 
+                                           controller:getStreamOutput(i), 
+                                           mtmsg.newbuffer())
+        mixers[i]:activate()
+    end
+    controller:setCycleBudget(1e-9)
+    measureCycles("clear", controller)
+    for i = 1, routeCount do
+        mixers[i]:deactivate()
+    end
+    controller:closeStream()
+else
+    io.stderr:write("skipping clear benchmark: lua-auproc or lua-mtmsg not found\n")
+end
+
+----------------------------------------------------------------------------------------------------
+-- register: latency of connecting and disconnecting a route while other routes are
+--           registered.
+
+do
+    local controller = openController(1, 1)
+    local input      = controller:getStreamInput(1)
+    for i = 1, routeCount do
+        controller:connect(input, controller:newStreamBuffer())
+    end
+    local output = controller:getStreamOutput(1)
+    local n = math.max(1, math.floor(cycles / 10))
+    local connectTime, disconnectTime = 0, 0
+    for i = 1, n do
+        local t0 = clock()
+        controller:connect(input, output)
+        local t1 = clock()
+        controller:disconnect(input, output)
+        local t2 = clock()
+        connectTime    = connectTime    + (t1 - t0)
+        disconnectTime = disconnectTime + (t2 - t1)
+    end
+    emit("register", { count          = n,
+                       registerMean   = connectTime    / n,
+                       unregisterMean = disconnectTime / n })
+    controller:closeStream()
+end
+
+----------------------------------------------------------------------------------------------------
+-- midi: throughput of MIDI events that are written into a MIDI stream buffer by an
+--       auproc MIDI sender object.
+
+if hasAuproc and hasMtmsg and hasCarray then
+    local controller = openController(1, 1)
+    local nframes    = controller:getStreamBufferFrames()
+    local midiBuffer = controller:newStreamBuffer("MIDI")
+    local queue      = mtmsg.newbuffer()
+    local sender     = auproc.new_midi_sender(midiBuffer, queue)
+    local noteOn     = carray.new("uint8", 3)
+    noteOn:set(1, 0x90, 60, 100)
+    sender:activate()
+    local eventsPerCycle = 64
+    local total          = 0
+    local renderTime     = 0
+    for i = 1, math.max(1, math.floor(cycles / 10)) do
+        for e = 1, eventsPerCycle do
+            queue:addmsg((e - 1) % nframes, noteOn)
+        end
+        local t0 = clock()
+        controller:renderFrames(nframes)
+        renderTime = renderTime + (clock() - t0)
+        total = total + eventsPerCycle
+    end
+    sender:deactivate()
+    emit("midi", { events        = total,
+                   cpuTime       = renderTime,
+                   eventsPerSec  = total / renderTime })
+    controller:closeStream()
+else
+    io.stderr:write("skipping midi benchmark: lua-auproc, lua-mtmsg or lua-carray not found\n")
+end
+
+----------------------------------------------------------------------------------------------------
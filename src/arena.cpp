@@ -0,0 +1,200 @@
+#include "main.hpp"
+#include "arena.hpp"
+
+#if defined(LRTAUDIO_ASYNC_USE_WIN32)
+    #include <malloc.h>
+#endif
+
+using namespace lrtaudio;
+
+/* ============================================================================================ */
+
+static const size_t CHUNK_SIZE     = 1024 * 1024;
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+/* ============================================================================================ */
+
+struct lrtaudio::ArenaChunk
+{
+    ArenaChunk* next;
+    char*       data;
+    size_t      size;
+    bool        locked;
+};
+
+struct lrtaudio::ArenaBlock
+{
+    ArenaBlock* next;
+    size_t      size;
+};
+
+/* ============================================================================================ */
+
+static size_t roundUp(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+/* ============================================================================================ */
+
+static char* allocChunkData(size_t size, size_t alignment)
+{
+#if defined(LRTAUDIO_ASYNC_USE_WIN32)
+    return (char*) _aligned_malloc(size, alignment);
+#else
+    void* ptr = NULL;
+    if (posix_memalign(&ptr, alignment, size) != 0) {
+        return NULL;
+    }
+    return (char*) ptr;
+#endif
+}
+
+static void freeChunkData(char* data)
+{
+#if defined(LRTAUDIO_ASYNC_USE_WIN32)
+    _aligned_free(data);
+#else
+    free(data);
+#endif
+}
+
+/* ============================================================================================ */
+
+static bool lockMemory(char* data, size_t size)
+{
+#if defined(LRTAUDIO_ASYNC_USE_WIN32)
+    return VirtualLock(data, size) != 0;
+#else
+    return mlock(data, size) == 0;
+#endif
+}
+
+static void unlockMemory(char* data, size_t size)
+{
+#if defined(LRTAUDIO_ASYNC_USE_WIN32)
+    VirtualUnlock(data, size);
+#else
+    munlock(data, size);
+#endif
+}
+
+/* ============================================================================================ */
+
+static ArenaChunk* newChunk(Arena* arena, size_t minSize)
+{
+    size_t pageSize = arena->hugePages ? HUGE_PAGE_SIZE : arena::ALIGNMENT;
+    size_t size     = roundUp(minSize > CHUNK_SIZE ? minSize : CHUNK_SIZE, pageSize);
+
+    ArenaChunk* chunk = (ArenaChunk*) calloc(1, sizeof(ArenaChunk));
+    if (!chunk) {
+        return NULL;
+    }
+    chunk->data = allocChunkData(size, pageSize);
+    if (!chunk->data) {
+        free(chunk);
+        return NULL;
+    }
+    chunk->size = size;
+#if defined(MADV_HUGEPAGE)
+    if (arena->hugePages) {
+        madvise(chunk->data, size, MADV_HUGEPAGE);
+    }
+#endif
+    memset(chunk->data, 0, size); // pre-fault all pages
+
+    chunk->locked = lockMemory(chunk->data, size);
+    if (!chunk->locked && !arena->lockFailed) {
+        arena->lockFailed = true;
+        lrtaudio::log_info("lrtaudio: cannot lock stream buffer memory, buffers may be paged out");
+    }
+    return chunk;
+}
+
+/* ============================================================================================ */
+
+Arena* arena::new_arena(bool hugePages)
+{
+    Arena* arena = (Arena*) calloc(1, sizeof(Arena));
+    if (arena) {
+        arena->hugePages = hugePages;
+    }
+    return arena;
+}
+
+/* ============================================================================================ */
+
+void arena::free_arena(Arena* arena)
+{
+    ArenaChunk* chunk = arena->chunks;
+    while (chunk) {
+        ArenaChunk* next = chunk->next;
+        if (chunk->locked) {
+            unlockMemory(chunk->data, chunk->size);
+        }
+        freeChunkData(chunk->data);
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
+
+/* ============================================================================================ */
+
+void* arena::alloc_buffer(Arena* arena, size_t size)
+{
+    size = roundUp(size > 0 ? size : 1, ALIGNMENT);
+
+    ArenaBlock** ptr = &arena->freeBlocks;
+    while (*ptr) {
+        ArenaBlock* block = *ptr;
+        if (block->size >= size) {
+            if (block->size - size >= ALIGNMENT) {
+                ArenaBlock* rest = (ArenaBlock*)((char*)block + size);
+                rest->size = block->size - size;
+                rest->next = block->next;
+                *ptr = rest;
+            } else {
+                *ptr = block->next;
+            }
+            memset(block, 0, size);
+            return block;
+        }
+        ptr = &block->next;
+    }
+    if (arena->available < size) {
+        ArenaChunk* chunk = newChunk(arena, size);
+        if (!chunk) {
+            return NULL;
+        }
+        if (arena->chunks && arena->available > 0) {
+            // keep the remainder of the current chunk for smaller buffers
+            ArenaBlock* rest = (ArenaBlock*) arena->current;
+            rest->size = arena->available;
+            rest->next = arena->freeBlocks;
+            arena->freeBlocks = rest;
+        }
+        chunk->next      = arena->chunks;
+        arena->chunks    = chunk;
+        arena->current   = chunk->data;
+        arena->available = chunk->size;
+    }
+    void* rslt = arena->current;
+    arena->current   += size;
+    arena->available -= size;
+    return rslt;
+}
+
+/* ============================================================================================ */
+
+void arena::free_buffer(Arena* arena, void* ptr, size_t size)
+{
+    if (ptr) {
+        ArenaBlock* block = (ArenaBlock*) ptr;
+        block->size = roundUp(size > 0 ? size : 1, ALIGNMENT);
+        block->next = arena->freeBlocks;
+        arena->freeBlocks = block;
+    }
+}
+
+/* ============================================================================================ */
@@ -0,0 +1,58 @@
+#ifndef LRTAUDIO_ARENA_HPP
+#define LRTAUDIO_ARENA_HPP
+
+#include "util.h"
+
+/* ============================================================================================ */
+namespace lrtaudio {
+/* ============================================================================================ */
+
+struct ArenaChunk;
+struct ArenaBlock;
+
+/**
+ * Per stream memory for buffers that are used in the process cycle.
+ * Buffers are allocated contiguously from large chunks that are
+ * pre-faulted and locked into physical memory, so that the realtime
+ * thread does not run into page faults.
+ */
+struct Arena
+{
+    bool         hugePages;
+    bool         lockFailed;
+    ArenaChunk*  chunks;
+    char*        current;     // next free position in the first chunk
+    size_t       available;   // free bytes in the first chunk
+    ArenaBlock*  freeBlocks;  // released buffers for reuse
+};
+
+/* ============================================================================================ */
+namespace arena {
+/* ============================================================================================ */
+
+static const size_t ALIGNMENT = 64;
+
+/**
+ * hugePages - if true, transparent huge pages are requested for the chunks
+ *             (only effective on Linux).
+ */
+Arena* new_arena(bool hugePages);
+
+void free_arena(Arena* arena);
+
+/**
+ * Returns zeroed memory of at least size bytes, aligned to ALIGNMENT.
+ * Returns NULL if out of memory. Must not be called from the realtime thread.
+ */
+void* alloc_buffer(Arena* arena, size_t size);
+
+/**
+ * size must be the size given to alloc_buffer.
+ */
+void free_buffer(Arena* arena, void* ptr, size_t size);
+
+/* ============================================================================================ */
+} } // namespace lrtaudio::arena
+/* ============================================================================================ */
+
+#endif // LRTAUDIO_ARENA_HPP
@@ -64,8 +64,14 @@
         #define _XOPEN_SOURCE 600 /* must be defined before any other include */
     #endif
     #include <errno.h>
+    #include <time.h>
     #include <sys/time.h>
     #include <pthread.h>
+    #if defined(__APPLE__) && defined(__MACH__)
+        #include <dispatch/dispatch.h>
+    #else
+        #include <semaphore.h>
+    #endif
 #endif
 #if defined(LRTAUDIO_ASYNC_USE_WIN32) || defined(LRTAUDIO_ASYNC_USE_WINTHREAD)
     #include <windows.h>
@@ -182,6 +182,230 @@ bool lrtaudio_async_mutex_wait_millis(Mutex* mutex, int timeoutMillis)
 #endif
 }
 
+void lrtaudio_async_sem_init(Semaphore* sem)
+{
+#if defined(LRTAUDIO_ASYNC_USE_PTHREAD)
+  #if defined(__APPLE__) && defined(__MACH__)
+    sem->sem = dispatch_semaphore_create(0);
+    if (!sem->sem) { async_util_abort(0, __LINE__); }
+  #else
+    int rc = sem_init(&sem->sem, 0, 0);
+    if (rc != 0) { async_util_abort(errno, __LINE__); }
+  #endif
+
+#elif defined(LRTAUDIO_ASYNC_USE_WINTHREAD)
+    sem->sem = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+    if (sem->sem == NULL) { async_util_abort(GetLastError(), __LINE__); }
+
+#elif defined(LRTAUDIO_ASYNC_USE_STDTHREAD)
+    int rc = mtx_init(&sem->mutex, mtx_plain);
+    if (rc != thrd_success) { async_util_abort(rc, __LINE__); }
+
+    rc = cnd_init(&sem->condition);
+    if (rc != thrd_success) { async_util_abort(rc, __LINE__); }
+    
+    sem->count = 0;
+#endif
+}
+
+void lrtaudio_async_sem_destruct(Semaphore* sem)
+{
+#if defined(LRTAUDIO_ASYNC_USE_PTHREAD)
+  #if defined(__APPLE__) && defined(__MACH__)
+    dispatch_release(sem->sem);
+  #else
+    sem_destroy(&sem->sem);
+  #endif
+#elif defined(LRTAUDIO_ASYNC_USE_WINTHREAD)
+    CloseHandle(sem->sem);
+#elif defined(LRTAUDIO_ASYNC_USE_STDTHREAD)
+    cnd_destroy(&sem->condition);
+    mtx_destroy(&sem->mutex);
+#endif
+}
+
+void lrtaudio_async_sem_post(Semaphore* sem)
+{
+#if defined(LRTAUDIO_ASYNC_USE_PTHREAD)
+  #if defined(__APPLE__) && defined(__MACH__)
+    dispatch_semaphore_signal(sem->sem);
+  #else
+    int rc = sem_post(&sem->sem);
+    if (rc != 0) { async_util_abort(errno, __LINE__); }
+  #endif
+
+#elif defined(LRTAUDIO_ASYNC_USE_WINTHREAD)
+    if (!ReleaseSemaphore(sem->sem, 1, NULL)) { async_util_abort(GetLastError(), __LINE__); }
+
+#elif defined(LRTAUDIO_ASYNC_USE_STDTHREAD)
+    mtx_lock(&sem->mutex);
+    sem->count += 1;
+    cnd_signal(&sem->condition);
+    mtx_unlock(&sem->mutex);
+#endif
+}
+
+void lrtaudio_async_sem_wait(Semaphore* sem)
+{
+#if defined(LRTAUDIO_ASYNC_USE_PTHREAD)
+  #if defined(__APPLE__) && defined(__MACH__)
+    dispatch_semaphore_wait(sem->sem, DISPATCH_TIME_FOREVER);
+  #else
+    int rc;
+    do {
+        rc = sem_wait(&sem->sem);
+    } while (rc != 0 && errno == EINTR);
+    if (rc != 0) { async_util_abort(errno, __LINE__); }
+  #endif
+
+#elif defined(LRTAUDIO_ASYNC_USE_WINTHREAD)
+    DWORD rc = WaitForSingleObject(sem->sem, INFINITE);
+    if (rc != WAIT_OBJECT_0) { async_util_abort(rc, __LINE__); }
+
+#elif defined(LRTAUDIO_ASYNC_USE_STDTHREAD)
+    mtx_lock(&sem->mutex);
+    while (sem->count == 0) {
+        cnd_wait(&sem->condition, &sem->mutex);
+    }
+    sem->count -= 1;
+    mtx_unlock(&sem->mutex);
+#endif
+}
+
+bool lrtaudio_async_sem_trywait(Semaphore* sem)
+{
+#if defined(LRTAUDIO_ASYNC_USE_PTHREAD)
+  #if defined(__APPLE__) && defined(__MACH__)
+    return dispatch_semaphore_wait(sem->sem, DISPATCH_TIME_NOW) == 0;
+  #else
+    int rc;
+    do {
+        rc = sem_trywait(&sem->sem);
+    } while (rc != 0 && errno == EINTR);
+    if (rc == 0 || errno == EAGAIN) {
+        return (rc == 0);
+    } else {
+        return async_util_abort(errno, __LINE__);
+    }
+  #endif
+
+#elif defined(LRTAUDIO_ASYNC_USE_WINTHREAD)
+    DWORD rc = WaitForSingleObject(sem->sem, 0);
+    if (rc == WAIT_OBJECT_0 || rc == WAIT_TIMEOUT) {
+        return (rc == WAIT_OBJECT_0);
+    } else {
+        return async_util_abort(rc, __LINE__);
+    }
+
+#elif defined(LRTAUDIO_ASYNC_USE_STDTHREAD)
+    bool rslt = false;
+    mtx_lock(&sem->mutex);
+    if (sem->count > 0) {
+        sem->count -= 1;
+        rslt = true;
+    }
+    mtx_unlock(&sem->mutex);
+    return rslt;
+#endif
+}
+
+#if defined(LRTAUDIO_ASYNC_USE_PTHREAD)
+static void* threadEntry(void* arg)
+{
+    Thread* thread = (Thread*) arg;
+    thread->func(thread->arg);
+    return NULL;
+}
+#elif defined(LRTAUDIO_ASYNC_USE_WINTHREAD)
+static DWORD WINAPI threadEntry(LPVOID arg)
+{
+    Thread* thread = (Thread*) arg;
+    thread->func(thread->arg);
+    return 0;
+}
+#elif defined(LRTAUDIO_ASYNC_USE_STDTHREAD)
+static int threadEntry(void* arg)
+{
+    Thread* thread = (Thread*) arg;
+    thread->func(thread->arg);
+    return 0;
+}
+#endif
+
+bool lrtaudio_async_thread_start(Thread* thread, ThreadFunc func, void* arg)
+{
+    thread->func = func;
+    thread->arg  = arg;
+#if defined(LRTAUDIO_ASYNC_USE_PTHREAD)
+    return pthread_create(&thread->thread, NULL, threadEntry, thread) == 0;
+
+#elif defined(LRTAUDIO_ASYNC_USE_WINTHREAD)
+    thread->thread = CreateThread(NULL, 0, threadEntry, thread, 0, NULL);
+    return thread->thread != NULL;
+
+#elif defined(LRTAUDIO_ASYNC_USE_STDTHREAD)
+    return thrd_create(&thread->thread, threadEntry, thread) == thrd_success;
+#endif
+}
+
+void lrtaudio_async_thread_join(Thread* thread)
+{
+#if defined(LRTAUDIO_ASYNC_USE_PTHREAD)
+    int rc = pthread_join(thread->thread, NULL);
+    if (rc != 0) { async_util_abort(rc, __LINE__); }
+
+#elif defined(LRTAUDIO_ASYNC_USE_WINTHREAD)
+    DWORD rc = WaitForSingleObject(thread->thread, INFINITE);
+    if (rc != WAIT_OBJECT_0) { async_util_abort(rc, __LINE__); }
+    CloseHandle(thread->thread);
+
+#elif defined(LRTAUDIO_ASYNC_USE_STDTHREAD)
+    int rc = thrd_join(thread->thread, NULL);
+    if (rc != thrd_success) { async_util_abort(rc, __LINE__); }
+#endif
+}
+
+/* ============================================================================================ */
+
+void lrtaudio_async_sleep_millis(int millis)
+{
+#if defined(LRTAUDIO_ASYNC_USE_PTHREAD)
+    struct timespec t;
+    t.tv_sec  =  millis / 1000;
+    t.tv_nsec = (millis % 1000) * 1000000;
+    while (nanosleep(&t, &t) != 0 && errno == EINTR) {}
+
+#elif defined(LRTAUDIO_ASYNC_USE_WINTHREAD)
+    Sleep(millis);
+
+#elif defined(LRTAUDIO_ASYNC_USE_STDTHREAD)
+    struct timespec t;
+    t.tv_sec  =  millis / 1000;
+    t.tv_nsec = (millis % 1000) * 1000000;
+    while (thrd_sleep(&t, &t) == -1) {}
+#endif
+}
+
+/* ============================================================================================ */
+
+uint64_t lrtaudio_async_monotonic_nanos()
+{
+#if defined(LRTAUDIO_ASYNC_USE_WINTHREAD)
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER        counter;
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000
+         + (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart;
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+#endif
+}
+
 /* ============================================================================================ */
 } // extern "C"
 /* ============================================================================================ */
@@ -50,6 +50,19 @@ static inline void* atomic_get_ptr(AtomicPtr* ptr)
 #endif
 }
 
+static inline void* atomic_set_ptr(AtomicPtr* ptr, void* newPtr)
+{
+#if defined(LRTAUDIO_ASYNC_USE_WIN32)
+    return InterlockedExchangePointer(ptr, newPtr);
+#elif defined(LRTAUDIO_ASYNC_USE_STDATOMIC)
+    return (void*)atomic_exchange(ptr, (intptr_t)newPtr);
+#elif defined(LRTAUDIO_ASYNC_USE_GNU)
+    void* rslt = __sync_lock_test_and_set(ptr, newPtr);
+    __sync_synchronize();
+    return rslt;
+#endif
+}
+
 /* -------------------------------------------------------------------------------------------- */
 
 static inline int atomic_inc(AtomicCounter* value)
@@ -344,6 +357,119 @@ static inline void async_mutex_notify(Mutex* mutex)
 
 /* -------------------------------------------------------------------------------------------- */
 
+typedef struct
+{
+#if defined(LRTAUDIO_ASYNC_USE_PTHREAD)
+  #if defined(__APPLE__) && defined(__MACH__)
+    dispatch_semaphore_t  sem;
+  #else
+    sem_t                 sem;
+  #endif
+
+#elif defined(LRTAUDIO_ASYNC_USE_WINTHREAD)
+    HANDLE                sem;
+
+#elif defined(LRTAUDIO_ASYNC_USE_STDTHREAD)
+    mtx_t                 mutex;
+    cnd_t                 condition;
+    int                   count;
+#endif
+} Semaphore;
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define async_sem_init lrtaudio_async_sem_init
+void async_sem_init(Semaphore* sem);
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define async_sem_destruct lrtaudio_async_sem_destruct
+void async_sem_destruct(Semaphore* sem);
+
+/* -------------------------------------------------------------------------------------------- */
+
+/**
+ * Does not block, may be called from the realtime thread.
+ */
+#define async_sem_post lrtaudio_async_sem_post
+void async_sem_post(Semaphore* sem);
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define async_sem_wait lrtaudio_async_sem_wait
+void async_sem_wait(Semaphore* sem);
+
+/* -------------------------------------------------------------------------------------------- */
+
+/**
+ * Returns true if the semaphore could be decremented without blocking.
+ */
+#define async_sem_trywait lrtaudio_async_sem_trywait
+bool async_sem_trywait(Semaphore* sem);
+
+/* -------------------------------------------------------------------------------------------- */
+
+typedef void (*ThreadFunc)(void* arg);
+
+typedef struct
+{
+    ThreadFunc            func;
+    void*                 arg;
+#if defined(LRTAUDIO_ASYNC_USE_PTHREAD)
+    pthread_t             thread;
+
+#elif defined(LRTAUDIO_ASYNC_USE_WINTHREAD)
+    HANDLE                thread;
+
+#elif defined(LRTAUDIO_ASYNC_USE_STDTHREAD)
+    thrd_t                thread;
+#endif
+} Thread;
+
+/* -------------------------------------------------------------------------------------------- */
+
+/**
+ * Returns false if the thread could not be started.
+ */
+#define async_thread_start lrtaudio_async_thread_start
+bool async_thread_start(Thread* thread, ThreadFunc func, void* arg);
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define async_thread_join lrtaudio_async_thread_join
+void async_thread_join(Thread* thread);
+
+/* -------------------------------------------------------------------------------------------- */
+
+#define async_sleep_millis lrtaudio_async_sleep_millis
+void async_sleep_millis(int millis);
+
+/* -------------------------------------------------------------------------------------------- */
+
+/**
+ * Monotonic clock in nanoseconds, may be called from the realtime thread.
+ */
+#define async_monotonic_nanos lrtaudio_async_monotonic_nanos
+uint64_t async_monotonic_nanos();
+
+/* -------------------------------------------------------------------------------------------- */
+
+/**
+ * Hint for busy waiting loops.
+ */
+static inline void async_cpu_relax()
+{
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    __builtin_ia32_pause();
+#elif defined(__GNUC__) && defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#elif defined(LRTAUDIO_ASYNC_USE_WIN32)
+    YieldProcessor();
+#endif
+}
+
+/* -------------------------------------------------------------------------------------------- */
+
 #if defined(__cplusplus)
 } /* extern "C" */
 #endif
@@ -4,9 +4,12 @@
 #include "stream.hpp"
 #include "channel.hpp"
 #include "procbuf.hpp"
+#include "arena.hpp"
+#include "rtlog.hpp"
 
 using namespace lrtaudio;
 using stream::ProcReg;
+using stream::ProcList;
 using stream::ConnectorInfo;
 
 /* ============================================================================================ */
@@ -67,6 +70,14 @@ static float* channel_getAudioBuffer(auproc_connector* connector, uint32_t nfram
 static float* procbuf_getAudioBuffer(auproc_connector* connector, uint32_t nframes)
 {
     ProcBufUserData* udata = (ProcBufUserData*) connector;
+    ConnectorInfo*   alias = (ConnectorInfo*) atomic_get_ptr(&udata->aliasSource);
+    if (alias) {
+        if (alias->isChannel) {
+            return channel_getAudioBuffer((auproc_connector*) alias->channelUdata, nframes);
+        } else {
+            return procbuf_getAudioBuffer((auproc_connector*) alias->procBufUdata, nframes);
+        }
+    }
     if (nframes * sizeof(float) <= udata->bufferLength) {
         return (float*) udata->bufferData;
     } else {
@@ -74,6 +85,16 @@ static float* procbuf_getAudioBuffer(auproc_connector* connector, uint32_t nfram
     }
 }
 
+static float* slot_getAudioBuffer(auproc_connector* connector, uint32_t nframes)
+{
+    ConnectorInfo* info = (ConnectorInfo*) connector;
+    if (nframes <= info->slotFrames) {
+        return info->slotBuffer;
+    } else {
+        return NULL;
+    }
+}
+
 static auproc_midibuf* procbuf_getMidiBuffer(auproc_connector* connector, uint32_t nframes)
 {
     ProcBufUserData* udata = (ProcBufUserData*) connector;
@@ -96,6 +117,13 @@ static const auproc_audiometh procbuf_audio_methods =
 
 /* ============================================================================================ */
 
+static const auproc_audiometh slot_audio_methods =
+{
+    (audiometh_getAudioBuffer) slot_getAudioBuffer
+};
+
+/* ============================================================================================ */
+
 static const auproc_midimeth procbuf_midi_methods =
 {
     (midimeth_getMidiBuffer)     procbuf_getMidiBuffer,
@@ -234,10 +262,12 @@ static auproc_direction getPossibleDirections(lua_State* L, int index)
     getConnectorUdata(L, index, &channelUdata, &procBufUdata);
     auproc_direction rslt = AUPROC_NONE;
     if (channelUdata) {
-        if      (channelUdata->isInput)               rslt = AUPROC_IN;
-        else if (channelUdata->procUsageCounter == 0) rslt = AUPROC_OUT;
+        if (channelUdata->isInput) rslt = AUPROC_IN;
+        else                       rslt = AUPROC_OUT;
     }
     else if (procBufUdata) {
+        // registerProcessor also accepts additional writers, but the C API 
+        // promises AUPROC_IN for a stream buffer that already has a writer
         if (procBufUdata->outUsageCounter == 0) rslt = AUPROC_OUT;
         else                                    rslt = AUPROC_IN;
     }
@@ -258,7 +288,7 @@ static auproc_reg_err_type checkChannelReg(ControllerUserData* ctrlUdata,
         return AUPROC_REG_ERR_ENGINE_MISMATCH;
     }
     if (   (conReg->conDirection == AUPROC_IN  && !udata->isInput)
-        || (conReg->conDirection == AUPROC_OUT &&  (udata->isInput || udata->procUsageCounter > 0))) 
+        || (conReg->conDirection == AUPROC_OUT &&  udata->isInput)) 
     {
         return AUPROC_REG_ERR_WRONG_DIRECTION;
     }
@@ -283,9 +313,7 @@ static auproc_reg_err_type checkProcBufReg(ControllerUserData* ctrlUdata,
     if (udata->ctrlUdata != ctrlUdata) {
         return AUPROC_REG_ERR_ENGINE_MISMATCH;
     }
-    if ( (conReg->conDirection == AUPROC_IN  && udata->outUsageCounter == 0)
-      || (conReg->conDirection == AUPROC_OUT && udata->outUsageCounter != 0))
-    {
+    if (conReg->conDirection == AUPROC_IN && udata->outUsageCounter == 0) {
         return AUPROC_REG_ERR_WRONG_DIRECTION;
     }
     
@@ -301,6 +329,53 @@ static auproc_reg_err_type checkProcBufReg(ControllerUserData* ctrlUdata,
 }
 
 
+/* ============================================================================================ */
+
+/**
+ * true if the output connector of conInfos[index] already has a writer, i.e. 
+ * the processor gets its own buffer that is added to the output after processing
+ * for audio or that is merged with the other writers' buffers for MIDI.
+ */
+static bool hasOtherWriter(ConnectorInfo* conInfos, int index)
+{
+    ConnectorInfo* info = conInfos + index;
+    if (info->isChannel) {
+        if (info->channelUdata->procUsageCounter > 0) {
+            return true;
+        }
+    }
+    else if (info->isProcBuf) {
+        if (info->procBufUdata->outUsageCounter > 0) {
+            return true;
+        }
+    }
+    for (int i = 0; i < index; ++i) {
+        ConnectorInfo* other = conInfos + i;
+        if (   other->isOutput
+            && (   (info->isChannel && other->channelUdata == info->channelUdata)
+                || (info->isProcBuf && other->procBufUdata == info->procBufUdata)))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* ============================================================================================ */
+
+static void freeConnectorInfos(Stream* stream, ConnectorInfo* conInfos, int connectorCount)
+{
+    for (int i = 0; i < connectorCount; ++i) {
+        if (conInfos[i].slotBuffer) {
+            arena::free_buffer(stream->arena, conInfos[i].slotBuffer, conInfos[i].slotFrames * sizeof(float));
+        }
+        if (conInfos[i].slotMidi) {
+            procbuf::free_midi_slot(stream, conInfos[i].slotMidi);
+        }
+    }
+    free(conInfos);
+}
+
 /* ============================================================================================ */
 
 static auproc_processor* registerProcessor(lua_State* L, 
@@ -374,28 +449,19 @@ static auproc_processor* registerProcessor(lua_State* L,
     }
     int connectorTableRef = luaL_ref(L, LUA_REGISTRYINDEX);   /* -> */
     
-    ProcReg** oldList = stream->procRegList;
-    int       n       = stream->procRegCount;
+    ProcList* oldList = stream->procRegList;
     
     ProcReg*        newReg    = (ProcReg*) calloc(1, sizeof(ProcReg));
-    int             newLength = n + 1;
-    ProcReg**       newList   = (ProcReg**) calloc(newLength + 1, sizeof(ProcReg*));
     ConnectorInfo*  conInfos  = (ConnectorInfo*) calloc(connectorCount, sizeof(ConnectorInfo));
     char*           procName  = (char*) malloc(strlen(processorName) + 1);
-    if (!newReg || !newList || !conInfos || !procName) {
+    if (!newReg || !conInfos || !procName) {
         if (newReg)   free(newReg);
-        if (newList)  free(newList);
         if (conInfos) free(conInfos);
         if (procName) free(procName);
         luaL_unref(L, LUA_REGISTRYINDEX, connectorTableRef);
         luaL_error(L, "out of memory");
         return NULL;
     }
-    if (oldList) {
-        memcpy(newList, oldList, sizeof(ProcReg*) * n);
-    }
-    newList[newLength-1] = newReg;
-    newList[newLength]   = NULL;
     strcpy(procName, processorName);
 
     newReg->processorName          = procName;
@@ -407,6 +473,7 @@ static auproc_processor* registerProcessor(lua_State* L,
     newReg->connectorTableRef      = connectorTableRef;
     newReg->connectorCount         = connectorCount;
     newReg->connectorInfos         = conInfos;
+    newReg->registrationNumber     = stream->procRegCounter++;
       
     for (int i = 0; i < connectorCount; ++i) {
         ChannelUserData* channelUdata = NULL;
@@ -414,63 +481,94 @@ static auproc_processor* registerProcessor(lua_State* L,
         getConnectorUdata(L, firstConnectorIndex + i, &channelUdata, &procBufUdata);
         if (channelUdata) {
             conInfos[i].isChannel = true;
-            channelUdata->procUsageCounter += 1;
-            if (conRegList[i].conDirection == AUPROC_IN) {
-                conInfos[i].isInput  = true;
-            } else {
-                conInfos[i].isOutput = true;
-            }
             conInfos[i].channelUdata = channelUdata;
         } 
         else if (procBufUdata) {
             conInfos[i].isProcBuf = true;
-            procBufUdata->procUsageCounter += 1;
-            if (conRegList[i].conDirection == AUPROC_IN) {
-                procBufUdata->inpUsageCounter += 1;
-                conInfos[i].isInput = true;
-            } else {
-                conInfos[i].isOutput = true;
-                procBufUdata->outUsageCounter += 1;
-            }
             conInfos[i].procBufUdata = procBufUdata;
         }
+        if (conRegList[i].conDirection == AUPROC_IN) {
+            conInfos[i].isInput  = true;
+        } else {
+            conInfos[i].isOutput = true;
+        }
     }
-
-    /* --------------------------------------------------------------------- */
-    async_mutex_lock(&stream->processMutex);
-    {
-        int rc = 0;
-        if (bufferSizeCallback) {
-            rc = bufferSizeCallback(stream->bufferFrames, processorData);
+    for (int i = 0; i < connectorCount; ++i) {
+        ConnectorInfo* info = conInfos + i;
+        if (info->isOutput && hasOtherWriter(conInfos, i)) {
+            if (info->isProcBuf && info->procBufUdata->isMidi) {
+                info->slotMidi = procbuf::new_midi_slot(info->procBufUdata);
+            } else {
+                info->slotBuffer = (float*) arena::alloc_buffer(stream->arena, stream->bufferFrames * sizeof(float));
+                info->slotFrames = stream->bufferFrames;
+            }
+            if (!info->slotBuffer && !info->slotMidi) {
+                free(newReg);
+                freeConnectorInfos(stream, conInfos, connectorCount);
+                free(procName);
+                luaL_unref(L, LUA_REGISTRYINDEX, connectorTableRef);
+                luaL_error(L, "out of memory");
+                return NULL;
+            }
+            newReg->hasWriterSlots = true;
         }
-        if (rc != 0) {
-            async_mutex_unlock(&stream->processMutex);
-            free(newReg);
-            free(newList);
-            free(conInfos);
-            free(procName);
-            luaL_unref(L, LUA_REGISTRYINDEX, connectorTableRef);
-            luaL_error(L, "error %d from bufferSizeCallback for processor '%s'", processorName);
-            return NULL;
+    }
+    ProcList* newList = stream::new_proc_list(oldList, newReg, NULL);
+    if (!newList) {
+        free(newReg);
+        freeConnectorInfos(stream, conInfos, connectorCount);
+        free(procName);
+        luaL_unref(L, LUA_REGISTRYINDEX, connectorTableRef);
+        luaL_error(L, "out of memory");
+        return NULL;
+    }
+    for (int i = 0; i < connectorCount; ++i) {
+        ConnectorInfo* info = conInfos + i;
+        if (info->isChannel) {
+            info->channelUdata->procUsageCounter += 1;
+        } 
+        else if (info->isProcBuf) {
+            info->procBufUdata->procUsageCounter += 1;
+            if (info->isInput) {
+                info->procBufUdata->inpUsageCounter += 1;
+            } else {
+                info->procBufUdata->outUsageCounter += 1;
+            }
         }
-        newReg->bufferFrames = stream->bufferFrames;
+    }
 
-        stream->procRegList  = newList;
-        stream->procRegCount = newLength;
-        stream::activate_proc_list_LOCKED(stream, newList);
+    int rc = 0;
+    if (bufferSizeCallback) {
+        rc = bufferSizeCallback(stream->bufferFrames, processorData);
     }
-    async_mutex_unlock(&stream->processMutex);
-    /* --------------------------------------------------------------------- */
-    
-    if (oldList) {
-        free(oldList);
+    if (rc != 0) {
+        free(newReg);
+        stream::free_proc_list(newList);
+        freeConnectorInfos(stream, conInfos, connectorCount);
+        free(procName);
+        luaL_unref(L, LUA_REGISTRYINDEX, connectorTableRef);
+        luaL_error(L, "error %d from bufferSizeCallback for processor '%s'", processorName);
+        return NULL;
     }
+    newReg->bufferFrames = stream->bufferFrames;
+
+    stream::update_proc_list(stream, newList); // does not wait for the realtime thread
     
     for (int i = 0; i < connectorCount; ++i) {
         ChannelUserData* channelUdata = NULL;
         ProcBufUserData* procBufUdata = NULL;
         getConnectorUdata(L, firstConnectorIndex + i, &channelUdata, &procBufUdata);
-        if (channelUdata) {
+        if (conInfos[i].slotBuffer) {
+            conRegList[i].connector = (auproc_connector*)(conInfos + i);
+            conRegList[i].audioMethods = &slot_audio_methods;
+            conRegList[i].midiMethods  = NULL;
+        }
+        else if (conInfos[i].slotMidi) {
+            conRegList[i].connector = (auproc_connector*)(conInfos[i].slotMidi);
+            conRegList[i].audioMethods = NULL;
+            conRegList[i].midiMethods  = &procbuf_midi_methods;
+        }
+        else if (channelUdata) {
             conRegList[i].connector = (auproc_connector*)channelUdata;
             conRegList[i].audioMethods = &channel_audio_methods;
             conRegList[i].midiMethods  = NULL;
@@ -492,16 +590,47 @@ static auproc_processor* registerProcessor(lua_State* L,
 
 /* ============================================================================================ */
 
-static void releaseProcReg(lua_State* L, ProcReg* reg)
+static bool isActivated(ProcReg* reg)
+{
+    return reg->hasPendingActivation ? reg->pendingActivated : reg->activated;
+}
+
+/* ============================================================================================ */
+
+static void setActivated(lua_State* L, Stream* stream, ProcReg* reg, bool activated)
+{
+    if (!stream || !stream->isOpen) {
+        reg->activated = activated;
+    }
+    else if (stream->inTransaction) {
+        reg->hasPendingActivation = true;
+        reg->pendingActivated     = activated;
+    } else {
+        ProcList* newList;
+        reg->activated = activated;
+        newList = stream::new_proc_list(stream->procRegList, NULL, NULL);
+        if (!newList) {
+            reg->activated = !activated;
+            luaL_error(L, "out of memory");
+            return;
+        }
+        stream::update_proc_list(stream, newList);
+    }
+}
+
+/* ============================================================================================ */
+
+static void releaseProcReg(lua_State* L, Stream* stream, ProcReg* reg)
 {
     reg->processorData        = NULL;
     reg->processCallback      = NULL;
     reg->engineClosedCallback = NULL;
     
-    bool wasActivated = reg->activated;
+    bool wasActivated = isActivated(reg);
     if (wasActivated) {
         reg->activated = false;
     }
+    reg->hasPendingActivation = false;
     if (reg->connectorTableRef != LUA_REFNIL) {
         lua_rawgeti(L, LUA_REGISTRYINDEX, reg->connectorTableRef);  /* -> connectorTable */
         for (int i = 1; i <= reg->connectorCount; ++i) {
@@ -533,12 +662,12 @@ static void releaseProcReg(lua_State* L, ProcReg* reg)
         lua_pop(L, 1);                                         /* -> */
         luaL_unref(L, LUA_REGISTRYINDEX, reg->connectorTableRef);
         reg->connectorTableRef = LUA_REFNIL;
-        reg->connectorCount = 0;
     }
     if (reg->connectorInfos) {
-        free(reg->connectorInfos);
+        freeConnectorInfos(stream, reg->connectorInfos, reg->connectorCount);
         reg->connectorInfos = NULL;
     }
+    reg->connectorCount = 0;
     if (reg->processorName) {
         free(reg->processorName);
         reg->processorName = NULL;
@@ -556,13 +685,12 @@ static void unregisterProcessor(lua_State* L,
     ProcReg*            reg       = (ProcReg*)            processor;
     Stream*             stream    = ctrlUdata->stream;
     
-    int       n       = stream->procRegCount;
-    ProcReg** oldList = stream->procRegList;
+    ProcList* oldList = stream->procRegList;
 
     int index = -1;
     if (oldList) {
-        for (int i = 0; i < n; ++i) {
-            if (oldList[i] == reg) {
+        for (int i = 0; i < oldList->count; ++i) {
+            if (oldList->regs[i] == reg) {
                 index = i;
                 break;
             }
@@ -576,7 +704,7 @@ static void unregisterProcessor(lua_State* L,
     for (int i = 0; i < reg->connectorCount; ++i) {
         ConnectorInfo* info = reg->connectorInfos + i;
         if (info->isProcBuf && info->isOutput) {
-            if (info->procBufUdata->inpUsageCounter > 0) {
+            if (info->procBufUdata->inpUsageCounter > 0 && info->procBufUdata->outUsageCounter == 1) {
                 luaL_error(L, "process buffer %p data is used by another registered processor", info->procBufUdata);
                 return;
             }
@@ -585,31 +713,33 @@ static void unregisterProcessor(lua_State* L,
 
     /* --------------------------------------------------------------------- */
     
-    ProcReg** newList = (ProcReg**) malloc(sizeof(ProcReg*) * (n - 1 + 1));
-    
+    ProcList* newList = stream::new_proc_list(oldList, NULL, reg);
+    ProcList* pubList = NULL;
+
+    if (newList && stream->inTransaction && stream::is_published(stream, reg)) {
+        // the realtime thread must stop using reg before this call returns, 
+        // other changes of the transaction remain pending.
+        pubList = stream::new_proc_list((ProcList*) atomic_get_ptr(&stream->activeProcRegList), NULL, reg);
+        if (!pubList) {
+            stream::free_proc_list(newList);
+            newList = NULL;
+        }
+    }
     if (!newList) {
         luaL_error(L, "out of memory");
         return;
     }
-    if (index > 0) {
-        memcpy(newList, oldList, sizeof(ProcReg*) * index);
-    }
-    if (index + 1 <= n) {
-        memcpy(newList + index, oldList + index + 1, sizeof(ProcReg*) * ((n + 1) - (index + 1)));
-    }
     
-    async_mutex_lock(&stream->processMutex);
-    {
-        stream->procRegList  = newList;
-        stream->procRegCount = n - 1;
-        
-        stream::activate_proc_list_LOCKED(stream, newList);
+    stream::update_proc_list(stream, newList);
+    if (pubList) {
+        stream::publish_proc_list(stream, pubList);
     }
-    async_mutex_unlock(&stream->processMutex);
     
-    releaseProcReg(L, reg);
+    // reg and processorData may be freed by the caller: wait until
+    // the realtime thread no longer uses any list containing reg.
+    stream::reclaim_proc_lists(stream, true);
 
-    free(oldList);
+    releaseProcReg(L, stream, reg);
 }
 
 /* ============================================================================================ */
@@ -622,8 +752,12 @@ static void activateProcessor(lua_State* L,
     ProcReg*            reg       = (ProcReg*)         processor;
     Stream*             stream    = ctrlUdata->stream;
 
-    if (!reg->activated) 
+    atomic_set(&reg->failed, 0); // processor deactivated by its error policy is activated again
+
+    if (!isActivated(reg)) 
     {
+        setActivated(L, stream, reg, true);
+
         for (int i = 0; i < reg->connectorCount; ++i) {
             ConnectorInfo* info = reg->connectorInfos + i;
             if (info->isProcBuf) {
@@ -634,7 +768,6 @@ static void activateProcessor(lua_State* L,
                 }
             }
         }
-        reg->activated = true;
     }
 }
 
@@ -648,8 +781,10 @@ static void deactivateProcessor(lua_State* L,
     ProcReg*            reg       = (ProcReg*)         processor;
     Stream*             stream    = ctrlUdata->stream;
 
-    if (reg->activated)
+    if (isActivated(reg))
     {
+        setActivated(L, stream, reg, false);
+
         for (int i = 0; i < reg->connectorCount; ++i) {
             ConnectorInfo* info = reg->connectorInfos + i;
             if (info->isProcBuf) {
@@ -660,7 +795,6 @@ static void deactivateProcessor(lua_State* L,
                 }
             }
         }
-        reg->activated = false;
     }
 }
 
@@ -682,7 +816,7 @@ static void logError(auproc_engine* engine, const char* fmt, ...)
     do {
         va_list args;
         va_start(args, fmt);
-            finished = lrtaudio::log_errorV(fmt, args);
+            finished = rtlog::log_errorV(fmt, args);
         va_end(args);
     } while (!finished);
 }
@@ -695,7 +829,7 @@ static void logInfo(auproc_engine* engine, const char* fmt, ...)
     do {
         va_list args;
         va_start(args, fmt);
-            finished = lrtaudio::log_infoV(fmt, args);
+            finished = rtlog::log_infoV(fmt, args);
         va_end(args);
     } while (!finished);
 }
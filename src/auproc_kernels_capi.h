@@ -0,0 +1,155 @@
+#ifndef AUPROC_KERNELS_CAPI_H
+#define AUPROC_KERNELS_CAPI_H
+
+#define AUPROC_KERNELS_CAPI_ID_STRING     "_capi_auproc_kernels"
+
+#define AUPROC_KERNELS_CAPI_VERSION_MAJOR  0
+#define AUPROC_KERNELS_CAPI_VERSION_MINOR  0
+#define AUPROC_KERNELS_CAPI_VERSION_PATCH  1
+
+#ifndef AUPROC_KERNELS_CAPI_IMPLEMENT_SET_CAPI
+#  define AUPROC_KERNELS_CAPI_IMPLEMENT_SET_CAPI 0
+#endif
+
+#ifndef AUPROC_KERNELS_CAPI_IMPLEMENT_GET_CAPI
+#  define AUPROC_KERNELS_CAPI_IMPLEMENT_GET_CAPI 0
+#endif
+
+#ifdef __cplusplus
+
+extern "C" {
+
+struct auproc_kernels_capi;
+
+#else /* __cplusplus */
+
+typedef struct auproc_kernels_capi  auproc_kernels_capi;
+
+#endif /* ! __cplusplus */
+
+/**
+ *  Auproc Kernels C API.
+ *
+ *  Vectorized functions for common operations on audio buffers. The
+ *  implementation is chosen at runtime according to the instruction
+ *  set of the CPU. All functions may be called in the processCallback.
+ *  Buffers do not need to be aligned. Source and destination buffers
+ *  must not overlap unless they are identical.
+ *
+ *  The Auproc Kernels C API is available in the metatables of objects that
+ *  implement the Auproc C API, e.g. auproc engine and connector objects.
+ */
+struct auproc_kernels_capi
+{
+    int version_major;
+    int version_minor;
+    int version_patch;
+
+    /**
+     * May point to another (incompatible) version of this API implementation.
+     * NULL if no such implementation exists.
+     *
+     * The usage of next_capi makes it possible to implement two or more
+     * incompatible versions of the C API.
+     *
+     * An API is compatible to another API if both have the same major
+     * version number and if the minor version number of the first API is
+     * greater or equal than the second one's.
+     */
+    void* next_capi;
+
+    /**
+     * Name of the instruction set used by the implementation,
+     * e.g. "scalar", "sse2" or "avx".
+     */
+    const char* (*getInstructionSet)(void);
+
+    /**
+     * buffer[i] = 0
+     */
+    void (*clearBuffer)(float* buffer, uint32_t nframes);
+
+    /**
+     * dst[i] = src[i]
+     */
+    void (*copyBuffer)(float* dst, const float* src, uint32_t nframes);
+
+    /**
+     * dst[i] = gain * src[i]
+     */
+    void (*copyScaledBuffer)(float* dst, const float* src, float gain, uint32_t nframes);
+
+    /**
+     * buffer[i] = gain * buffer[i]
+     */
+    void (*scaleBuffer)(float* buffer, float gain, uint32_t nframes);
+
+    /**
+     * dst[i] = dst[i] + src[i]
+     */
+    void (*addBuffer)(float* dst, const float* src, uint32_t nframes);
+
+    /**
+     * dst[i] = dst[i] + gain * src[i]
+     */
+    void (*addScaledBuffer)(float* dst, const float* src, float gain, uint32_t nframes);
+};
+
+
+#if AUPROC_KERNELS_CAPI_IMPLEMENT_SET_CAPI
+/**
+ * Sets the Auproc Kernels C API into the metatable at the given index.
+ *
+ * index: index of the table that is be used as metatable for objects
+ *        that are associated to the given capi.
+ */
+static int auproc_kernels_set_capi(lua_State* L, int index, const auproc_kernels_capi* capi)
+{
+    lua_pushlstring(L, AUPROC_KERNELS_CAPI_ID_STRING, strlen(AUPROC_KERNELS_CAPI_ID_STRING));             /* -> key */
+    void** udata = (void**) lua_newuserdata(L, sizeof(void*) + strlen(AUPROC_KERNELS_CAPI_ID_STRING) + 1); /* -> key, value */
+    *udata = (void*)capi;
+    strcpy((char*)(udata + 1), AUPROC_KERNELS_CAPI_ID_STRING);    /* -> key, value */
+    lua_rawset(L, (index < 0) ? (index - 2) : index);             /* -> */
+    return 0;
+}
+#endif /* AUPROC_KERNELS_CAPI_IMPLEMENT_SET_CAPI */
+
+#if AUPROC_KERNELS_CAPI_IMPLEMENT_GET_CAPI
+/**
+ * Gives the associated Auproc Kernels C API for the object at the given stack index.
+ */
+static const auproc_kernels_capi* auproc_kernels_get_capi(lua_State* L, int index, int* versionError)
+{
+    if (luaL_getmetafield(L, index, AUPROC_KERNELS_CAPI_ID_STRING) == LUA_TUSERDATA) /* -> _capi */
+    {
+        const void** udata = (const void**) lua_touserdata(L, -1);                   /* -> _capi */
+
+        if (   (lua_rawlen(L, -1) >= sizeof(void*) + strlen(AUPROC_KERNELS_CAPI_ID_STRING) + 1)
+            && (memcmp((char*)(udata + 1), AUPROC_KERNELS_CAPI_ID_STRING,
+                       strlen(AUPROC_KERNELS_CAPI_ID_STRING) + 1) == 0))
+        {
+            const auproc_kernels_capi* capi = (const auproc_kernels_capi*) *udata;   /* -> _capi */
+            while (capi) {
+                if (   capi->version_major == AUPROC_KERNELS_CAPI_VERSION_MAJOR
+                    && capi->version_minor >= AUPROC_KERNELS_CAPI_VERSION_MINOR)
+                {                                                                    /* -> _capi */
+                    lua_pop(L, 1);                                                   /* -> */
+                    return capi;
+                }
+                capi = (const auproc_kernels_capi*) capi->next_capi;
+            }
+            if (versionError) {
+                *versionError = 1;
+            }
+        }                                                                         /* -> _capi */
+        lua_pop(L, 1);                                                            /* -> */
+    }                                                                             /* -> */
+    return NULL;
+}
+#endif /* AUPROC_KERNELS_CAPI_IMPLEMENT_GET_CAPI */
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* AUPROC_KERNELS_CAPI_H */
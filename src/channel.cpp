@@ -1,4 +1,5 @@
 #define AUPROC_CAPI_IMPLEMENT_SET_CAPI 1
+#define AUPROC_KERNELS_CAPI_IMPLEMENT_SET_CAPI 1
 
 #include "main.hpp"
 #include "controller.hpp"
@@ -6,6 +7,7 @@
 #include "channel.hpp"
 #include "auproc_capi.h"
 #include "auproc_capi_impl.hpp"
+#include "kernels.hpp"
 
 using namespace lrtaudio;
 
@@ -135,6 +137,7 @@ static void setupChannelMeta(lua_State* L)
     luaL_setfuncs(L, ChannelMethods, 0);           /* -> meta, ChannelClass */
     lua_setfield (L, -2, "__index");             /* -> meta */
     auproc_set_capi(L, -1, &auproc::capi_impl);
+    auproc_kernels_set_capi(L, -1, &kernels::capi_impl);
 }
 
 /* ============================================================================================ */
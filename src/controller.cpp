@@ -1,4 +1,5 @@
 #define AUPROC_CAPI_IMPLEMENT_SET_CAPI 1
+#define AUPROC_KERNELS_CAPI_IMPLEMENT_SET_CAPI 1
 #define RECEIVER_CAPI_IMPLEMENT_GET_CAPI 1
 
 #include "error.hpp"
@@ -9,10 +10,18 @@
 #include "procbuf.hpp"
 #include "auproc_capi.h"
 #include "auproc_capi_impl.hpp"
+#include "kernels.hpp"
+#include "route.hpp"
+#include "recorder.hpp"
+#include "player.hpp"
+#include "midiport.hpp"
+#include "stats.hpp"
+#include "vdevice.hpp"
 #include "receiver_capi.h"
 
 using namespace lrtaudio;
 using stream::open_stream;
+using stream::open_offline_stream;
 using stream::close_stream;
 using stream::release_stream;
 
@@ -260,7 +269,7 @@ static int Controller_info(lua_State* L)
                 stream->streamNameRef != LUA_REFNIL 
                     ? quoteString(L, (lua_rawgeti(L, LUA_REGISTRYINDEX, stream->streamNameRef),
                                       lua_tostring(L, -1))) : "nil",
-                udata->api->getStreamSampleRate(),
+                stream->sampleRate,
                 stream->bufferFrames,
                 stream->numberOfBuffers
             ); pushed(L, &n);
@@ -292,7 +301,7 @@ static int Controller_getDeviceCount(lua_State* L)
 {
     try {
         ControllerUserData* udata = checkCtrlUdata(L, 1);
-        lua_pushinteger(L, udata->api->getDeviceCount());
+        lua_pushinteger(L, udata->api->getDeviceCount() + 1); // with virtual device
         return 1;
     }
     catch (...) { return lrtaudio::handleException(L); }
@@ -410,6 +419,25 @@ static int pushDeviceInfo(lua_State* L, int index, const RtAudio::DeviceInfo& de
 
 /* ============================================================================================ */
 
+/**
+ * The virtual device has the deviceId following the RtAudio devices.
+ */
+static lua_Integer getVirtualDeviceId(ControllerUserData* udata)
+{
+    return udata->api->getDeviceCount() + 1;
+}
+
+static RtAudio::DeviceInfo getDeviceInfo(ControllerUserData* udata, lua_Integer deviceId)
+{
+    if (deviceId == getVirtualDeviceId(udata)) {
+        RtAudio::DeviceInfo info;
+        vdevice::get_device_info(&info);
+        return info;
+    } else {
+        return udata->api->getDeviceInfo(deviceId - 1);
+    }
+}
+
 static int Controller_getDeviceInfo(lua_State* L)
 {
     try {
@@ -421,14 +449,14 @@ static int Controller_getDeviceInfo(lua_State* L)
             hasDeviceId = true;
         }
         if (hasDeviceId) {
-            if (deviceId <= 0 || deviceId > udata->api->getDeviceCount()) {
+            if (deviceId <= 0 || deviceId > getVirtualDeviceId(udata)) {
                 return luaL_argerror(L, 2, "invalid deviceId");
             }
-            pushDeviceInfo(L, deviceId, udata->api->getDeviceInfo(deviceId - 1));
+            pushDeviceInfo(L, deviceId, getDeviceInfo(udata, deviceId));
         } else {
             lua_newtable(L);   // -> list
-            for (int i = 0; i < udata->api->getDeviceCount(); ++i) {
-                pushDeviceInfo(L, i+1, udata->api->getDeviceInfo(i)); // -> list, deviceInfo
+            for (int i = 0; i < getVirtualDeviceId(udata); ++i) {
+                pushDeviceInfo(L, i+1, getDeviceInfo(udata, i+1)); // -> list, deviceInfo
                 lua_rawseti(L, -2, i+1); // -> list
             }
         }
@@ -575,6 +603,33 @@ static int fillStreamParameters(lua_State* L, RtAudio* api,
     return 0;
 }
 
+/* ============================================================================================ */
+
+/**
+ * Chooses the sample format that is supported natively by the given devices, 
+ * RTAUDIO_FLOAT32 if there is no common native format.
+ */
+static RtAudioFormat chooseNativeFormat(RtAudio::DeviceInfo* inputInfo, RtAudio::DeviceInfo* outputInfo)
+{
+    static const RtAudioFormat preferred[] = { RTAUDIO_FLOAT32, RTAUDIO_SINT32, RTAUDIO_SINT24, 
+                                               RTAUDIO_SINT16,  RTAUDIO_FLOAT64, RTAUDIO_SINT8 };
+    RtAudioFormat formats = ~(RtAudioFormat)0;
+    if (inputInfo) {
+        formats &= inputInfo->nativeFormats;
+    }
+    if (outputInfo) {
+        formats &= outputInfo->nativeFormats;
+    }
+    for (size_t i = 0; i < sizeof(preferred)/sizeof(preferred[0]); ++i) {
+        if (formats & preferred[i]) {
+            return preferred[i];
+        }
+    }
+    return RTAUDIO_FLOAT32;
+}
+
+/* ============================================================================================ */
+
 static int Controller_openStream(lua_State* L)
 {
     try {
@@ -594,6 +649,7 @@ static int Controller_openStream(lua_State* L)
         lua_Integer sampleRate = -1;
         lua_Integer bufferFrames = 256;
         lua_Integer numberOfBuffers = -1;
+        lua_Integer workerThreads = 0;
 
         RtAudio::StreamOptions options;
         options.flags = RTAUDIO_NONINTERLEAVED;
@@ -602,6 +658,10 @@ static int Controller_openStream(lua_State* L)
         bool hogDevice        = false;
         bool scheduleRealtime = false;
         bool alsaUseDefault   = false;
+        bool nativeFormat     = false;
+        bool hugePages        = false;
+        bool offline          = false;
+        lua_Number jitter     = 0;
         
         if (!lua_isnoneornil(L, initArg)) 
         {
@@ -637,6 +697,8 @@ static int Controller_openStream(lua_State* L)
                         options.numberOfBuffers = numberOfBuffers;
                     }
                 }
+                else if (checkArgTableValueInt(L, initArg, key, "workerThreads", 0, &workerThreads)) 
+                {}
                 else if (checkArgTableValueType(L, initArg, key, "streamName", LUA_TSTRING)) 
                 {
                     options.streamName = lua_tostring(L, -1);
@@ -657,6 +719,25 @@ static int Controller_openStream(lua_State* L)
                 {
                     alsaUseDefault = lua_toboolean(L, -1);
                 }
+                else if (checkArgTableValueType(L, initArg, key, "nativeFormat", LUA_TBOOLEAN)) 
+                {
+                    nativeFormat = lua_toboolean(L, -1);
+                }
+                else if (checkArgTableValueType(L, initArg, key, "hugePages", LUA_TBOOLEAN)) 
+                {
+                    hugePages = lua_toboolean(L, -1);
+                }
+                else if (checkArgTableValueType(L, initArg, key, "offline", LUA_TBOOLEAN)) 
+                {
+                    offline = lua_toboolean(L, -1);
+                }
+                else if (checkArgTableValueType(L, initArg, key, "jitter", LUA_TNUMBER)) 
+                {
+                    jitter = lua_tonumber(L, -1);
+                    if (jitter < 0) {
+                        return luaL_argerror(L, initArg, "invalid jitter");
+                    }
+                }
                 else {
                     return luaL_argerror(L, initArg, 
                                          lua_pushfstring(L, "unexpected table key '%s'", 
@@ -689,6 +770,62 @@ static int Controller_openStream(lua_State* L)
             return luaL_error(L, "cannot open stream without input and output channels");
         }
 
+        if (offline) {
+            if (inputDevice > 0 || outputDevice > 0) {
+                return luaL_argerror(L, initArg, "devices cannot be used with offline stream");
+            }
+            if (bufferFrames <= 0) {
+                return luaL_argerror(L, initArg, "invalid bufferFrames");
+            }
+            open_offline_stream(L, udata, sampleRate > 0 ? sampleRate : 48000, bufferFrames,
+                                inputChannels > 0 ? inputChannels : 0, 
+                                outputChannels > 0 ? outputChannels : 0, 
+                                workerThreads, hugePages);
+            if (!udata->stream) {
+                return luaL_error(L, "error allocating stream");
+            }
+            return 0;
+        }
+
+        lua_Integer virtualDeviceId = getVirtualDeviceId(udata);
+        if (inputChannels > 0 && inputDevice <= 0) {
+            inputDevice = 1 + udata->api->getDefaultInputDevice();
+        }
+        if (outputChannels > 0 && outputDevice <= 0) {
+            outputDevice = 1 + udata->api->getDefaultOutputDevice();
+        }
+        if (inputDevice == virtualDeviceId || outputDevice == virtualDeviceId) {
+            if (   (inputChannels  > 0 && inputDevice  != virtualDeviceId)
+                || (outputChannels > 0 && outputDevice != virtualDeviceId)) 
+            {
+                return luaL_argerror(L, initArg, "virtual device cannot be combined with other devices");
+            }
+            if (   inputChannels  > vdevice::CHANNELS || firstInputChannel  > 1
+                || outputChannels > vdevice::CHANNELS || firstOutputChannel > 1)
+            {
+                return luaL_argerror(L, initArg, "invalid channels for virtual device");
+            }
+            if (bufferFrames <= 0) {
+                return luaL_argerror(L, initArg, "invalid bufferFrames");
+            }
+            open_offline_stream(L, udata, sampleRate > 0 ? sampleRate : vdevice::SAMPLE_RATE, bufferFrames,
+                                inputChannels > 0 ? inputChannels : 0, 
+                                outputChannels > 0 ? outputChannels : 0, 
+                                workerThreads, hugePages);
+            if (!udata->stream) {
+                return luaL_error(L, "error allocating stream");
+            }
+            Stream* stream = udata->stream;
+            stream->inputDeviceId  = inputChannels  > 0 ? virtualDeviceId : 0;
+            stream->outputDeviceId = outputChannels > 0 ? virtualDeviceId : 0;
+            stream->virtualDevice  = vdevice::new_virtual_device(stream, jitter, scheduleRealtime ? options.priority : -1);
+            if (!stream->virtualDevice) {
+                close_stream(udata); // not usable as offline stream
+                return luaL_error(L, "out of memory");
+            }
+            return 0;
+        }
+
         if (firstInputChannel > inputChannels) {
             return luaL_argerror(L, initArg, "invalid firstInputChannel");
         }
@@ -729,7 +866,16 @@ static int Controller_openStream(lua_State* L)
             }
         }
 
-        open_stream(L, udata, sampleRate, bufferFrames, &options,
+        RtAudioFormat sampleFormat = RTAUDIO_FLOAT32;
+        if (nativeFormat) {
+            sampleFormat = chooseNativeFormat(inpParams ? &inputDeviceInfo  : NULL, 
+                                              outParams ? &outputDeviceInfo : NULL);
+            if (udata->api->getCurrentApi() != RtAudio::UNIX_JACK) {
+                options.flags &= ~RTAUDIO_NONINTERLEAVED;
+            }
+        }
+
+        open_stream(L, udata, sampleRate, bufferFrames, sampleFormat, workerThreads, hugePages, &options,
                               outParams, inpParams);
         
         if (!udata->stream) {
@@ -748,10 +894,17 @@ static int Controller_startStream(lua_State* L)
     try {
         ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
         if (!udata->stream->isRunning) {
-            LRTAUDIO_CHECK(
-                udata->api,
-                udata->api->startStream()
-            );
+            if (udata->stream->virtualDevice) {
+                if (!vdevice::start(udata->stream->virtualDevice)) {
+                    return luaL_error(L, "error starting virtual device");
+                }
+            }
+            else if (!udata->stream->isOffline) {
+                LRTAUDIO_CHECK(
+                    udata->api,
+                    udata->api->startStream()
+                );
+            }
             udata->stream->isRunning = true;
         }
         return 0;
@@ -766,10 +919,15 @@ static int Controller_stopStream(lua_State* L)
     try {
         ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
         if (udata->stream->isRunning) {
-            LRTAUDIO_CHECK(
-                udata->api,
-                udata->api->stopStream()
-            )
+            if (udata->stream->virtualDevice) {
+                vdevice::stop(udata->stream->virtualDevice);
+            }
+            else if (!udata->stream->isOffline) {
+                LRTAUDIO_CHECK(
+                    udata->api,
+                    udata->api->stopStream()
+                )
+            }
             udata->stream->isRunning = false;
         }
         return 0;
@@ -779,6 +937,51 @@ static int Controller_stopStream(lua_State* L)
 
 /* ============================================================================================ */
 
+static int Controller_beginTransaction(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        stream::begin_transaction(L, udata->stream);
+        return 0;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
+static int Controller_commitTransaction(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        stream::commit_transaction(L, udata->stream);
+        return 0;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
+static int Controller_renderFrames(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        lua_Integer nframes = luaL_checkinteger(L, 2);
+        if (nframes < 0) {
+            return luaL_argerror(L, 2, "number of frames must not be negative");
+        }
+        if (!udata->stream->isOffline || udata->stream->virtualDevice) {
+            return luaL_error(L, "stream is not an offline stream");
+        }
+        uint32_t rendered = stream::render_offline(udata->stream, (uint32_t)nframes);
+        stream::check_not_closed(L, udata);
+        lua_pushinteger(L, rendered);
+        return 1;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
 static int Controller_getFrameTime(lua_State* L)
 {
     try {
@@ -820,7 +1023,7 @@ static int Controller_getStreamLatency(lua_State* L)
 {
     try {
         ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
-        lua_pushinteger(L, udata->api->getStreamLatency());
+        lua_pushinteger(L, udata->stream->isOffline ? 0 : udata->api->getStreamLatency());
         return 1;
     }
     catch (...) { return lrtaudio::handleException(L); }
@@ -834,7 +1037,7 @@ static int Controller_getInputDeviceInfo(lua_State* L)
         ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
         if (udata->stream->inputDeviceId > 0) {
             return pushDeviceInfo(L, udata->stream->inputDeviceId,
-                                     udata->api->getDeviceInfo(udata->stream->inputDeviceId - 1));
+                                     getDeviceInfo(udata, udata->stream->inputDeviceId));
         }
         return 0;
     }
@@ -849,7 +1052,7 @@ static int Controller_getOutputDeviceInfo(lua_State* L)
         ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
         if (udata->stream->outputDeviceId > 0) {
             return pushDeviceInfo(L, udata->stream->outputDeviceId, 
-                                     udata->api->getDeviceInfo(udata->stream->outputDeviceId - 1));
+                                     getDeviceInfo(udata, udata->stream->outputDeviceId));
         }
         return 0;
     }
@@ -869,11 +1072,22 @@ static int Controller_newStreamBuffer(lua_State* L)
 {
     int arg = 1;
     ControllerUserData* ctrlUdata = checkCtrlUdataOpen(L, arg++, true);
-    int type = luaL_checkoption(L, arg, "AUDIO", procBufTypes);
+    int type = luaL_checkoption(L, arg++, "AUDIO", procBufTypes);
     
     bool isMidi = (type == 0);
 
-    procbuf::push_new_procbuf(L, ctrlUdata, isMidi);
+    size_t midiBufferSize = procbuf::default_midi_buffer_size(ctrlUdata->stream->bufferFrames);
+    if (!lua_isnoneornil(L, arg)) {
+        lua_Integer size = luaL_checkinteger(L, arg);
+        if (!isMidi) {
+            return luaL_argerror(L, arg, "size is only supported for MIDI stream buffers");
+        }
+        if (size < (lua_Integer) procbuf::MIN_MIDI_BUFFER_SIZE || size > 0x7fffffff) {
+            return luaL_argerror(L, arg, "invalid MIDI buffer size");
+        }
+        midiBufferSize = (size_t) size;
+    }
+    procbuf::push_new_procbuf(L, ctrlUdata, isMidi, midiBufferSize);
     
     return 1;
 
@@ -881,6 +1095,426 @@ static int Controller_newStreamBuffer(lua_State* L)
 
 /* ============================================================================================ */
 
+static int Controller_connect(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        stream::check_not_closed(L, udata);
+        route::connect(L, udata, 2, 3);
+        return 0;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
+static int Controller_disconnect(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        stream::check_not_closed(L, udata);
+        route::disconnect(L, udata, 2, 3);
+        return 0;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
+static RecorderFormat formatFromPath(const char* path)
+{
+    const char* ext = strrchr(path, '.');
+    if (ext && strcmp(ext, ".caf") == 0) return RECORDER_CAF;
+    if (ext && strcmp(ext, ".raw") == 0) return RECORDER_RAW;
+    return RECORDER_WAV;
+}
+
+static int Controller_startRecording(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        stream::check_not_closed(L, udata);
+        
+        const char* path          = luaL_checkstring(L, 2);
+        int         connectorsArg = 3;
+        int         optionsArg    = 4;
+        luaL_checkany(L, connectorsArg);
+
+        RecorderFormat format        = formatFromPath(path);
+        lua_Number     bufferSeconds = 2;
+        bool           directIO      = false;
+        
+        if (!lua_isnoneornil(L, optionsArg)) 
+        {
+            luaL_checktype(L, optionsArg, LUA_TTABLE);
+            lua_pushnil(L);                     /* -> nil */
+            while (lua_next(L, optionsArg)) {   /* -> key, value */
+                if (lua_type(L, -2) != LUA_TSTRING) {
+                    return luaL_argerror(L, optionsArg, 
+                                         lua_pushfstring(L, "got table key of type %s, but string expected", 
+                                                         lua_typename(L, lua_type(L, -2))));
+                }
+                const char* key = lua_tostring(L, -2);
+
+                     if (checkArgTableValueType(L, optionsArg, key, "format", LUA_TSTRING))
+                {
+                    const char* f = lua_tostring(L, -1);
+                         if (strcmp(f, "wav") == 0) format = RECORDER_WAV;
+                    else if (strcmp(f, "caf") == 0) format = RECORDER_CAF;
+                    else if (strcmp(f, "raw") == 0) format = RECORDER_RAW;
+                    else {
+                        return luaL_argerror(L, optionsArg, 
+                                             lua_pushfstring(L, "invalid format '%s'", f));
+                    }
+                }
+                else if (checkArgTableValueType(L, optionsArg, key, "bufferSeconds", LUA_TNUMBER)) 
+                {
+                    bufferSeconds = lua_tonumber(L, -1);
+                    if (bufferSeconds <= 0) {
+                        return luaL_argerror(L, optionsArg, "invalid bufferSeconds");
+                    }
+                }
+                else if (checkArgTableValueType(L, optionsArg, key, "directIO", LUA_TBOOLEAN)) 
+                {
+                    directIO = lua_toboolean(L, -1);
+                }
+                else {
+                    return luaL_argerror(L, optionsArg, 
+                                         lua_pushfstring(L, "unexpected table key '%s'", 
+                                                         key));
+                }                               /* -> key, value */
+                lua_pop(L, 1);                  /* -> key */
+            }                                   /* -> */
+        }
+        recorder::start_recording(L, udata, path, connectorsArg, format, bufferSeconds, directIO);
+        return 0;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
+static int Controller_stopRecording(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        stream::check_not_closed(L, udata);
+        recorder::stop_recording(L, udata, luaL_checkstring(L, 2));
+        return 2;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
+static int Controller_startPlayback(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        stream::check_not_closed(L, udata);
+        
+        const char* path          = luaL_checkstring(L, 2);
+        int         connectorsArg = 3;
+        int         optionsArg    = 4;
+        luaL_checkany(L, connectorsArg);
+
+        player::PlayerOptions options;
+        memset(&options, 0, sizeof(options));
+        options.loopEnd          = -1;
+        options.readAheadSeconds = 2;
+        
+        lua_Integer startTime   = -1;
+        lua_Integer position    = 0;
+        lua_Integer loopStart   = 0;
+        lua_Integer loopEnd     = -1;
+        lua_Integer rawChannels = 0;
+
+        if (!lua_isnoneornil(L, optionsArg)) 
+        {
+            luaL_checktype(L, optionsArg, LUA_TTABLE);
+            lua_pushnil(L);                     /* -> nil */
+            while (lua_next(L, optionsArg)) {   /* -> key, value */
+                if (lua_type(L, -2) != LUA_TSTRING) {
+                    return luaL_argerror(L, optionsArg, 
+                                         lua_pushfstring(L, "got table key of type %s, but string expected", 
+                                                         lua_typename(L, lua_type(L, -2))));
+                }
+                const char* key = lua_tostring(L, -2);
+
+                     if (checkArgTableValueInt(L, optionsArg, key, "startTime", 0, &startTime))
+                {
+                    options.hasStartTime = true;
+                }
+                else if (checkArgTableValueInt(L, optionsArg, key, "position", 0, &position)) 
+                {}
+                else if (checkArgTableValueType(L, optionsArg, key, "loop", LUA_TBOOLEAN)) 
+                {
+                    options.loop = lua_toboolean(L, -1);
+                }
+                else if (checkArgTableValueInt(L, optionsArg, key, "loopStart", 0, &loopStart)) 
+                {}
+                else if (checkArgTableValueInt(L, optionsArg, key, "loopEnd", 1, &loopEnd)) 
+                {}
+                else if (checkArgTableValueInt(L, optionsArg, key, "channels", 1, &rawChannels)) 
+                {}
+                else if (checkArgTableValueType(L, optionsArg, key, "readAhead", LUA_TNUMBER)) 
+                {
+                    options.readAheadSeconds = lua_tonumber(L, -1);
+                    if (options.readAheadSeconds <= 0) {
+                        return luaL_argerror(L, optionsArg, "invalid readAhead");
+                    }
+                }
+                else {
+                    return luaL_argerror(L, optionsArg, 
+                                         lua_pushfstring(L, "unexpected table key '%s'", 
+                                                         key));
+                }                               /* -> key, value */
+                lua_pop(L, 1);                  /* -> key */
+            }                                   /* -> */
+        }
+        options.startTime   = (uint32_t) startTime;
+        options.position    = position    < 0x7fffffff ? (int) position    : 0x7fffffff;
+        options.loopStart   = loopStart   < 0x7fffffff ? (int) loopStart   : 0x7fffffff;
+        options.loopEnd     = loopEnd     < 0x7fffffff ? (int) loopEnd     : 0x7fffffff;
+        options.rawChannels = rawChannels < 0x7fff     ? (int) rawChannels : 0x7fff;
+        
+        player::start_playback(L, udata, path, connectorsArg, &options);
+        return 0;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
+static int Controller_stopPlayback(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        stream::check_not_closed(L, udata);
+        const char* path         = luaL_checkstring(L, 2);
+        bool        hasFrameTime = !lua_isnoneornil(L, 3);
+        uint32_t    frameTime    = hasFrameTime ? (uint32_t) luaL_checkinteger(L, 3) : 0;
+        player::stop_playback(L, udata, path, hasFrameTime, frameTime);
+        return 0;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
+static int Controller_seekPlayback(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        stream::check_not_closed(L, udata);
+        const char* path         = luaL_checkstring(L, 2);
+        lua_Integer position     = luaL_checkinteger(L, 3);
+        bool        hasFrameTime = !lua_isnoneornil(L, 4);
+        uint32_t    frameTime    = hasFrameTime ? (uint32_t) luaL_checkinteger(L, 4) : 0;
+        if (position < 0) {
+            return luaL_argerror(L, 3, "position must not be negative");
+        }
+        player::seek_playback(L, udata, path, position < 0x7fffffff ? (int) position : 0x7fffffff,
+                              hasFrameTime, frameTime);
+        return 0;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
+static int Controller_getPlaybackPosition(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        stream::check_not_closed(L, udata);
+        player::push_playback_position(L, udata, luaL_checkstring(L, 2));
+        return 2;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
+static int Controller_enableProcessorStats(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        bool enabled = lua_isnoneornil(L, 2) || lua_toboolean(L, 2);
+        atomic_set(&udata->stream->measureLoad, enabled ? 1 : 0);
+        return 0;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
+static int Controller_getProcessorStats(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        bool reset = lua_toboolean(L, 2);
+        stats::push_stream_stats(L, udata->stream, reset);
+        return 1;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
+static int Controller_getXrunStats(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        bool reset = lua_toboolean(L, 2);
+        stats::push_xrun_stats(L, &udata->stream->xrunStats, reset);
+        return 1;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
+static int Controller_setCycleBudget(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        lua_Number budget = luaL_optnumber(L, 2, 0);
+        if (budget < 0) {
+            return luaL_argerror(L, 2, "budget must not be negative");
+        }
+        Stream*    stream = udata->stream;
+        lua_Number period = stream->sampleRate > 0 ? (lua_Number)stream->bufferFrames / stream->sampleRate 
+                                                   : 0;
+        lua_Number micros = budget * period * 1e6;
+        if (budget > 0 && micros < 1) {
+            micros = 1;
+        }
+        atomic_set(&stream->cycleBudgetMicros, micros < 0x7fffffff ? (int)micros : 0x7fffffff);
+        return 0;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
+static int Controller_setProcessorPriority(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        const char* name     = luaL_checkstring(L, 2);
+        int         priority = (int) luaL_checkinteger(L, 3);
+        if (stream::set_processor_priority(udata->stream, name, priority) == 0) {
+            return luaL_argerror(L, 2, "no registered processor with this name");
+        }
+        return 0;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
+static int Controller_setProcessorErrorPolicy(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        const char* name       = luaL_checkstring(L, 2);
+        const char* policyName = luaL_checkstring(L, 3);
+        lua_Number  retryDelay = luaL_optnumber(L, 4, 0.1);
+
+        stream::ErrorPolicy policy;
+        if (strcmp(policyName, "stop") == 0) {
+            policy = stream::ERROR_POLICY_STOP;
+        } else if (strcmp(policyName, "deactivate") == 0) {
+            policy = stream::ERROR_POLICY_DEACTIVATE;
+        } else if (strcmp(policyName, "retry") == 0) {
+            policy = stream::ERROR_POLICY_RETRY;
+        } else {
+            return luaL_argerror(L, 3, "invalid error policy");
+        }
+        if (retryDelay < 0) {
+            return luaL_argerror(L, 4, "retry delay must not be negative");
+        }
+        lua_Number retryFrames = retryDelay * udata->stream->sampleRate;
+        if (retryFrames > 0x7fffffff) {
+            retryFrames = 0x7fffffff;
+        }
+        if (stream::set_processor_error_policy(udata->stream, name, policy, (uint32_t)retryFrames) == 0) {
+            return luaL_argerror(L, 2, "no registered processor with this name");
+        }
+        return 0;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
+static int Controller_openMidiInput(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        stream::check_not_closed(L, udata);
+        
+        const char* device = luaL_checkstring(L, 2);
+
+        size_t midiBufferSize = procbuf::default_midi_buffer_size(udata->stream->bufferFrames);
+        if (!lua_isnoneornil(L, 3)) {
+            lua_Integer size = luaL_checkinteger(L, 3);
+            if (size < (lua_Integer) procbuf::MIN_MIDI_BUFFER_SIZE || size > 0x7fffffff) {
+                return luaL_argerror(L, 3, "invalid MIDI buffer size");
+            }
+            midiBufferSize = (size_t) size;
+        }
+        midiport::open_midi_input(L, udata, device, midiBufferSize);
+        return 1;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
+static int Controller_openMidiOutput(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        stream::check_not_closed(L, udata);
+        
+        const char* device = luaL_checkstring(L, 2);
+        luaL_checkany(L, 3);
+        midiport::open_midi_output(L, udata, device, 3);
+        return 0;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
+static int Controller_closeMidiInput(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        stream::check_not_closed(L, udata);
+        midiport::close_midi_port(L, udata, luaL_checkstring(L, 2), true);
+        return 1;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
+static int Controller_closeMidiOutput(lua_State* L)
+{
+    try {
+        ControllerUserData* udata = checkCtrlUdataOpen(L, 1, true);
+        stream::check_not_closed(L, udata);
+        midiport::close_midi_port(L, udata, luaL_checkstring(L, 2), false);
+        return 1;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
 static const luaL_Reg ControllerMethods[] = 
 {
     { "getCurrentApi",           Controller_getCurrentApi          },
@@ -894,8 +1528,11 @@ static const luaL_Reg ControllerMethods[] =
     { "startStream",             Controller_startStream            },
     { "stopStream",              Controller_stopStream             },
     { "closeStream",             Controller_closeStream            },
+    { "beginTransaction",        Controller_beginTransaction       },
+    { "commitTransaction",       Controller_commitTransaction      },
     { "close",                   Controller_release                },
     { "getFrameTime",            Controller_getFrameTime           },
+    { "renderFrames",            Controller_renderFrames           },
     { "getStreamBufferFrames",   Controller_getStreamBufferFrames  },
     { "getStreamSampleRate",     Controller_getStreamSampleRate    },
     { "getStreamLatency",        Controller_getStreamLatency       },
@@ -903,6 +1540,24 @@ static const luaL_Reg ControllerMethods[] =
     { "getOutputDeviceInfo",     Controller_getOutputDeviceInfo    },
     { "info",                    Controller_info                   },
     { "newStreamBuffer",         Controller_newStreamBuffer        },
+    { "connect",                 Controller_connect                },
+    { "disconnect",              Controller_disconnect             },
+    { "startRecording",          Controller_startRecording         },
+    { "stopRecording",           Controller_stopRecording          },
+    { "startPlayback",           Controller_startPlayback          },
+    { "stopPlayback",            Controller_stopPlayback           },
+    { "seekPlayback",            Controller_seekPlayback           },
+    { "getPlaybackPosition",     Controller_getPlaybackPosition    },
+    { "openMidiInput",           Controller_openMidiInput          },
+    { "openMidiOutput",          Controller_openMidiOutput         },
+    { "closeMidiInput",          Controller_closeMidiInput         },
+    { "closeMidiOutput",         Controller_closeMidiOutput        },
+    { "enableProcessorStats",    Controller_enableProcessorStats   },
+    { "getProcessorStats",       Controller_getProcessorStats      },
+    { "getXrunStats",            Controller_getXrunStats           },
+    { "setCycleBudget",          Controller_setCycleBudget         },
+    { "setProcessorPriority",    Controller_setProcessorPriority   },
+    { "setProcessorErrorPolicy", Controller_setProcessorErrorPolicy },
     { NULL,                      NULL } /* sentinel */
 };
 
@@ -933,6 +1588,7 @@ static void setupControllerMeta(lua_State* L)
     luaL_setfuncs(L, ControllerMethods, 0);           /* -> meta, RtaudioClass */
     lua_setfield (L, -2, "__index");                   /* -> meta */
     auproc_set_capi(L, -1, &auproc::capi_impl);
+    auproc_kernels_set_capi(L, -1, &kernels::capi_impl);
 }
 
 
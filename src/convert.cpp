@@ -0,0 +1,274 @@
+#include "convert.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define LRTAUDIO_CONVERT_USE_SSE2 1
+    #include <emmintrin.h>
+#else
+    #define LRTAUDIO_CONVERT_USE_SSE2 0
+#endif
+
+using namespace lrtaudio;
+
+/* ============================================================================================ */
+
+static const float INT8_SCALE  = 1.0f / 128.0f;
+static const float INT16_SCALE = 1.0f / 32768.0f;
+static const float INT24_SCALE = 1.0f / 8388608.0f;
+static const float INT32_SCALE = 1.0f / 2147483648.0f;
+
+static const float INT8_MAX_F  = 127.0f;
+static const float INT16_MAX_F = 32767.0f;
+static const float INT24_MAX_F = 8388607.0f;
+static const float INT32_MAX_F = 2147483520.0f; // largest float below 2^31
+
+/* ============================================================================================ */
+
+static inline float clip(float x)
+{
+    return x < -1.0f ? -1.0f : (x > 1.0f ? 1.0f : x);
+}
+
+/* ============================================================================================ */
+
+size_t convert::sample_size(RtAudioFormat format)
+{
+    switch (format) {
+        case RTAUDIO_SINT8:   return 1;
+        case RTAUDIO_SINT16:  return 2;
+        case RTAUDIO_SINT24:  return 3;
+        case RTAUDIO_SINT32:  return 4;
+        case RTAUDIO_FLOAT32: return 4;
+        case RTAUDIO_FLOAT64: return 8;
+        default:              return 0;
+    }
+}
+
+/* ============================================================================================ */
+
+static void int16ToFloat(float* dst, const int16_t* src, int stride, uint32_t nframes)
+{
+    uint32_t i = 0;
+#if LRTAUDIO_CONVERT_USE_SSE2
+    const __m128 scale = _mm_set1_ps(INT16_SCALE);
+    if (stride == 1) {
+        for (; i + 8 <= nframes; i += 8) {
+            __m128i v  = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+            __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+            _mm_storeu_ps(dst + i,     _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+            _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+        }
+    } else {
+        for (; i + 4 <= nframes; i += 4) {
+            const int16_t* s = src + i * stride;
+            __m128i v = _mm_set_epi32(s[3*stride], s[2*stride], s[stride], s[0]);
+            _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+        }
+    }
+#endif
+    for (; i < nframes; ++i) {
+        dst[i] = src[i * stride] * INT16_SCALE;
+    }
+}
+
+/* ============================================================================================ */
+
+static void int32ToFloat(float* dst, const int32_t* src, int stride, uint32_t nframes)
+{
+    uint32_t i = 0;
+#if LRTAUDIO_CONVERT_USE_SSE2
+    const __m128 scale = _mm_set1_ps(INT32_SCALE);
+    if (stride == 1) {
+        for (; i + 4 <= nframes; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+            _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+        }
+    } else {
+        for (; i + 4 <= nframes; i += 4) {
+            const int32_t* s = src + i * stride;
+            __m128i v = _mm_set_epi32(s[3*stride], s[2*stride], s[stride], s[0]);
+            _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+        }
+    }
+#endif
+    for (; i < nframes; ++i) {
+        dst[i] = src[i * stride] * INT32_SCALE;
+    }
+}
+
+/* ============================================================================================ */
+
+static void float32ToFloat(float* dst, const float* src, int stride, uint32_t nframes)
+{
+    if (stride == 1) {
+        memcpy(dst, src, nframes * sizeof(float));
+        return;
+    }
+    uint32_t i = 0;
+#if LRTAUDIO_CONVERT_USE_SSE2
+    for (; i + 4 <= nframes; i += 4) {
+        const float* s = src + i * stride;
+        _mm_storeu_ps(dst + i, _mm_set_ps(s[3*stride], s[2*stride], s[stride], s[0]));
+    }
+#endif
+    for (; i < nframes; ++i) {
+        dst[i] = src[i * stride];
+    }
+}
+
+/* ============================================================================================ */
+
+static void floatToInt16(int16_t* dst, const float* src, int stride, uint32_t nframes)
+{
+    uint32_t i = 0;
+#if LRTAUDIO_CONVERT_USE_SSE2
+    const __m128 scale = _mm_set1_ps(INT16_MAX_F);
+    const __m128 minv  = _mm_set1_ps(-1.0f);
+    const __m128 maxv  = _mm_set1_ps( 1.0f);
+    if (stride == 1) {
+        for (; i + 8 <= nframes; i += 8) {
+            __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i),     minv), maxv);
+            __m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), minv), maxv);
+            __m128i v = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(a, scale)),
+                                        _mm_cvtps_epi32(_mm_mul_ps(b, scale)));
+            _mm_storeu_si128((__m128i*)(dst + i), v);
+        }
+    } else {
+        for (; i + 4 <= nframes; i += 4) {
+            __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), minv), maxv);
+            int32_t tmp[4];
+            _mm_storeu_si128((__m128i*)tmp, _mm_cvtps_epi32(_mm_mul_ps(a, scale)));
+            int16_t* d = dst + i * stride;
+            d[0]        = (int16_t) tmp[0];
+            d[stride]   = (int16_t) tmp[1];
+            d[2*stride] = (int16_t) tmp[2];
+            d[3*stride] = (int16_t) tmp[3];
+        }
+    }
+#endif
+    for (; i < nframes; ++i) {
+        float x = clip(src[i]) * INT16_MAX_F;
+        dst[i * stride] = (int16_t)(x < 0 ? x - 0.5f : x + 0.5f);
+    }
+}
+
+/* ============================================================================================ */
+
+static void floatToInt32(int32_t* dst, const float* src, int stride, uint32_t nframes)
+{
+    uint32_t i = 0;
+#if LRTAUDIO_CONVERT_USE_SSE2
+    const __m128 scale = _mm_set1_ps(INT32_MAX_F);
+    const __m128 minv  = _mm_set1_ps(-1.0f);
+    const __m128 maxv  = _mm_set1_ps( 1.0f);
+    if (stride == 1) {
+        for (; i + 4 <= nframes; i += 4) {
+            __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), minv), maxv);
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_cvtps_epi32(_mm_mul_ps(a, scale)));
+        }
+    } else {
+        for (; i + 4 <= nframes; i += 4) {
+            __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), minv), maxv);
+            int32_t tmp[4];
+            _mm_storeu_si128((__m128i*)tmp, _mm_cvtps_epi32(_mm_mul_ps(a, scale)));
+            int32_t* d = dst + i * stride;
+            d[0]        = tmp[0];
+            d[stride]   = tmp[1];
+            d[2*stride] = tmp[2];
+            d[3*stride] = tmp[3];
+        }
+    }
+#endif
+    for (; i < nframes; ++i) {
+        float x = clip(src[i]) * INT32_MAX_F;
+        dst[i * stride] = (int32_t)(x < 0 ? x - 0.5f : x + 0.5f);
+    }
+}
+
+/* ============================================================================================ */
+
+static void floatToFloat32(float* dst, const float* src, int stride, uint32_t nframes)
+{
+    if (stride == 1) {
+        memcpy(dst, src, nframes * sizeof(float));
+        return;
+    }
+    for (uint32_t i = 0; i < nframes; ++i) {
+        dst[i * stride] = src[i];
+    }
+}
+
+/* ============================================================================================ */
+
+void convert::to_float(float* dst, const void* src, RtAudioFormat format, int stride, uint32_t nframes)
+{
+    switch (format) {
+        case RTAUDIO_SINT8: {
+            const int8_t* s = (const int8_t*) src;
+            for (uint32_t i = 0; i < nframes; ++i) {
+                dst[i] = s[i * stride] * INT8_SCALE;
+            }
+            break;
+        }
+        case RTAUDIO_SINT16:  int16ToFloat  (dst, (const int16_t*) src, stride, nframes); break;
+        case RTAUDIO_SINT24: {
+            // packed 3 byte samples in little endian byte order
+            const unsigned char* s = (const unsigned char*) src;
+            for (uint32_t i = 0; i < nframes; ++i) {
+                const unsigned char* b = s + 3 * i * stride;
+                int32_t v = (int32_t)((uint32_t)b[0] << 8 | (uint32_t)b[1] << 16 | (uint32_t)b[2] << 24) >> 8;
+                dst[i] = v * INT24_SCALE;
+            }
+            break;
+        }
+        case RTAUDIO_SINT32:  int32ToFloat  (dst, (const int32_t*) src, stride, nframes); break;
+        case RTAUDIO_FLOAT32: float32ToFloat(dst, (const float*)   src, stride, nframes); break;
+        case RTAUDIO_FLOAT64: {
+            const double* s = (const double*) src;
+            for (uint32_t i = 0; i < nframes; ++i) {
+                dst[i] = (float) s[i * stride];
+            }
+            break;
+        }
+    }
+}
+
+/* ============================================================================================ */
+
+void convert::from_float(void* dst, const float* src, RtAudioFormat format, int stride, uint32_t nframes)
+{
+    switch (format) {
+        case RTAUDIO_SINT8: {
+            int8_t* d = (int8_t*) dst;
+            for (uint32_t i = 0; i < nframes; ++i) {
+                float x = clip(src[i]) * INT8_MAX_F;
+                d[i * stride] = (int8_t)(x < 0 ? x - 0.5f : x + 0.5f);
+            }
+            break;
+        }
+        case RTAUDIO_SINT16:  floatToInt16  ((int16_t*) dst, src, stride, nframes); break;
+        case RTAUDIO_SINT24: {
+            unsigned char* d = (unsigned char*) dst;
+            for (uint32_t i = 0; i < nframes; ++i) {
+                float   x = clip(src[i]) * INT24_MAX_F;
+                int32_t v = (int32_t)(x < 0 ? x - 0.5f : x + 0.5f);
+                unsigned char* b = d + 3 * i * stride;
+                b[0] = (unsigned char)(v);
+                b[1] = (unsigned char)(v >> 8);
+                b[2] = (unsigned char)(v >> 16);
+            }
+            break;
+        }
+        case RTAUDIO_SINT32:  floatToInt32  ((int32_t*) dst, src, stride, nframes); break;
+        case RTAUDIO_FLOAT32: floatToFloat32((float*)   dst, src, stride, nframes); break;
+        case RTAUDIO_FLOAT64: {
+            double* d = (double*) dst;
+            for (uint32_t i = 0; i < nframes; ++i) {
+                d[i * stride] = src[i];
+            }
+            break;
+        }
+    }
+}
+
+/* ============================================================================================ */
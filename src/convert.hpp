@@ -0,0 +1,36 @@
+#ifndef LRTAUDIO_CONVERT_HPP
+#define LRTAUDIO_CONVERT_HPP
+
+#include "util.h"
+
+/* ============================================================================================ */
+namespace lrtaudio {
+namespace convert {
+/* ============================================================================================ */
+
+/**
+ * Size in bytes of one sample in the given RtAudio sample format.
+ */
+size_t sample_size(RtAudioFormat format);
+
+/**
+ * Converts nframes samples of one channel from the given sample format
+ * into float samples.
+ *
+ * stride - distance between consecutive samples of the channel in number
+ *          of samples, i.e. 1 for non-interleaved buffers or the number
+ *          of channels for interleaved buffers.
+ */
+void to_float(float* dst, const void* src, RtAudioFormat format, int stride, uint32_t nframes);
+
+/**
+ * Converts nframes float samples of one channel into the given sample format.
+ * Samples are clipped to the range [-1.0, 1.0] for integer sample formats.
+ */
+void from_float(void* dst, const float* src, RtAudioFormat format, int stride, uint32_t nframes);
+
+/* ============================================================================================ */
+} } // namespace lrtaudio::convert
+/* ============================================================================================ */
+
+#endif // LRTAUDIO_CONVERT_HPP
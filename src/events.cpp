@@ -0,0 +1,183 @@
+#include "main.hpp"
+#include "events.hpp"
+
+#include "receiver_capi.h"
+
+using namespace lrtaudio;
+
+/* ============================================================================================ */
+
+static const int RING_CAPACITY = 256;
+
+/* ============================================================================================ */
+
+static void addIntegerToWriter(EventRing* ring, lua_Integer i)
+{
+    ring->receiverCapi->addIntegerToWriter(ring->writer, i);
+}
+
+static void addNumberToWriter(EventRing* ring, lua_Number n)
+{
+    ring->receiverCapi->addNumberToWriter(ring->writer, n);
+}
+
+static void addStringToWriter(EventRing* ring, const char* str)
+{
+    ring->receiverCapi->addStringToWriter(ring->writer, str, strlen(str));
+}
+
+static void addMsgToReceiver(EventRing* ring)
+{
+    int rc = ring->receiverCapi->msgToReceiver(ring->receiver, ring->writer,
+                                               false, false, NULL, NULL);
+    if (rc != 0) {
+        fprintf(stderr, "lrtaudio: error calling status receiver.");
+    }
+}
+
+/* ============================================================================================ */
+
+static void forwardEvent(EventRing* ring, StatusEvent* e)
+{
+    switch (e->type) {
+        case EVENT_PROCESSING_ERROR:
+            addStringToWriter (ring, "ProcessingError");
+            addStringToWriter (ring, "stream invalidated because processor returned processing error");
+            addStringToWriter (ring, e->processorName);
+            addIntegerToWriter(ring, e->value);
+            break;
+
+        case EVENT_PROCESSOR_DEACTIVATED:
+        case EVENT_PROCESSOR_RETRY:
+            addStringToWriter (ring, "ProcessorError");
+            addStringToWriter (ring, e->type == EVENT_PROCESSOR_DEACTIVATED
+                                     ? "processor deactivated because of processing error"
+                                     : "processor bypassed because of processing error, retrying later");
+            addStringToWriter (ring, e->processorName);
+            addIntegerToWriter(ring, e->value);
+            break;
+
+        case EVENT_XRUN: {
+            bool inputOverflow   = (e->value & RTAUDIO_INPUT_OVERFLOW)   != 0;
+            bool outputUnderflow = (e->value & RTAUDIO_OUTPUT_UNDERFLOW) != 0;
+            addStringToWriter (ring, "Xrun");
+            addStringToWriter (ring, inputOverflow && outputUnderflow ? "input overflow and output underflow"
+                                   : inputOverflow                    ? "input overflow"
+                                                                      : "output underflow");
+            addIntegerToWriter(ring, e->frameTime);
+            addNumberToWriter (ring, e->streamTime);
+            break;
+        }
+        case EVENT_DEGRADED:
+            addStringToWriter (ring, "ProcessingDegraded");
+            addStringToWriter (ring, "processors bypassed because cycle budget was exceeded");
+            addIntegerToWriter(ring, e->frameTime);
+            addIntegerToWriter(ring, e->value);
+            break;
+    }
+    addMsgToReceiver(ring);
+}
+
+/* ============================================================================================ */
+
+static void drainEvents(EventRing* ring)
+{
+    int dropped = atomic_get(&ring->dropped);
+    while (dropped > 0 && !atomic_set_if_equal(&ring->dropped, dropped, 0)) {
+        dropped = atomic_get(&ring->dropped);
+    }
+    if (dropped > 0) {
+        lrtaudio::log_info("lrtaudio: %d status events were lost", dropped);
+    }
+    int readIndex = atomic_get(&ring->readIndex);
+    while (readIndex != atomic_get(&ring->writeIndex)) {
+        forwardEvent(ring, ring->events + (readIndex & (ring->capacity - 1)));
+        readIndex += 1;
+        atomic_set(&ring->readIndex, readIndex);
+    }
+}
+
+/* ============================================================================================ */
+
+static void drainMain(void* arg)
+{
+    EventRing* ring = (EventRing*) arg;
+
+    while (true) {
+        async_sem_wait(&ring->wakeup);
+        drainEvents(ring);
+        if (atomic_get(&ring->shutdown)) {
+            break;
+        }
+    }
+}
+
+/* ============================================================================================ */
+
+EventRing* events::new_event_ring(const receiver_capi* receiverCapi, receiver_object* receiver)
+{
+    EventRing*   ring   = (EventRing*)   calloc(1, sizeof(EventRing));
+    StatusEvent* events = (StatusEvent*) calloc(RING_CAPACITY, sizeof(StatusEvent));
+    receiver_writer* writer = receiverCapi->newWriter(1024, 2);
+    if (!ring || !events || !writer) {
+        if (ring)   free(ring);
+        if (events) free(events);
+        if (writer) receiverCapi->freeWriter(writer);
+        return NULL;
+    }
+    ring->events       = events;
+    ring->capacity     = RING_CAPACITY;
+    ring->receiverCapi = receiverCapi;
+    ring->receiver     = receiver;
+    ring->writer       = writer;
+    async_sem_init(&ring->wakeup);
+
+    ring->started = async_thread_start(&ring->thread, drainMain, ring);
+    if (!ring->started) {
+        events::free_event_ring(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+/* ============================================================================================ */
+
+void events::free_event_ring(EventRing* ring)
+{
+    if (ring->started) {
+        atomic_set(&ring->shutdown, 1);
+        async_sem_post(&ring->wakeup);
+        async_thread_join(&ring->thread);
+    }
+    async_sem_destruct(&ring->wakeup);
+    ring->receiverCapi->freeWriter(ring->writer);
+    free(ring->events);
+    free(ring);
+}
+
+/* ============================================================================================ */
+
+void events::push_event(EventRing* ring, StatusEventType type, uint32_t frameTime, double streamTime,
+                        int value, const char* processorName)
+{
+    int writeIndex = atomic_get(&ring->writeIndex);
+    if (writeIndex - atomic_get(&ring->readIndex) >= ring->capacity) {
+        atomic_inc(&ring->dropped);
+        return;
+    }
+    StatusEvent* e = ring->events + (writeIndex & (ring->capacity - 1));
+    e->type       = type;
+    e->frameTime  = frameTime;
+    e->streamTime = streamTime;
+    e->value      = value;
+    if (processorName) {
+        strncpy(e->processorName, processorName, STATUS_EVENT_NAME_SIZE - 1);
+        e->processorName[STATUS_EVENT_NAME_SIZE - 1] = '\0';
+    } else {
+        e->processorName[0] = '\0';
+    }
+    atomic_set(&ring->writeIndex, writeIndex + 1);
+    async_sem_post(&ring->wakeup);
+}
+
+/* ============================================================================================ */
@@ -0,0 +1,91 @@
+#ifndef LRTAUDIO_EVENTS_HPP
+#define LRTAUDIO_EVENTS_HPP
+
+#include "util.h"
+
+/* ============================================================================================ */
+extern "C" {
+/* ============================================================================================ */
+
+struct receiver_capi;
+struct receiver_object;
+struct receiver_writer;
+
+/* ============================================================================================ */
+} // extern "C"
+/* ============================================================================================ */
+
+/* ============================================================================================ */
+namespace lrtaudio {
+/* ============================================================================================ */
+
+enum StatusEventType
+{
+    EVENT_PROCESSING_ERROR,     // stream invalidated, value: error code
+    EVENT_PROCESSOR_DEACTIVATED,// value: error code
+    EVENT_PROCESSOR_RETRY,      // value: error code
+    EVENT_XRUN,                 // value: RtAudioStreamStatus
+    EVENT_DEGRADED              // value: number of bypassed processors
+};
+
+static const int STATUS_EVENT_NAME_SIZE = 64;
+
+struct StatusEvent
+{
+    StatusEventType type;
+    uint32_t        frameTime;
+    double          streamTime;
+    int             value;
+    char            processorName[STATUS_EVENT_NAME_SIZE];
+};
+
+/**
+ * Preallocated single producer single consumer ring of status events.
+ * The realtime thread is the producer, a drain thread forwards the
+ * events as messages to the status receiver, i.e. the realtime thread
+ * never allocates memory or waits for locks in the status receiver.
+ */
+struct EventRing
+{
+    StatusEvent*   events;
+    int            capacity;    // power of 2
+    AtomicCounter  writeIndex;
+    AtomicCounter  readIndex;
+    AtomicCounter  dropped;     // events lost because the ring was full
+
+    const receiver_capi* receiverCapi;
+    receiver_object*     receiver;
+    receiver_writer*     writer;
+
+    Semaphore      wakeup;
+    AtomicCounter  shutdown;
+    Thread         thread;
+    bool           started;
+};
+
+/* ============================================================================================ */
+namespace events {
+/* ============================================================================================ */
+
+/**
+ * Starts the drain thread. Returns NULL on error.
+ */
+EventRing* new_event_ring(const receiver_capi* receiverCapi, receiver_object* receiver);
+
+/**
+ * Forwards all remaining events and stops the drain thread. The
+ * realtime thread must not push events anymore.
+ */
+void free_event_ring(EventRing* ring);
+
+/**
+ * Must only be called from the realtime thread. processorName may be NULL.
+ */
+void push_event(EventRing* ring, StatusEventType type, uint32_t frameTime, double streamTime,
+                int value, const char* processorName);
+
+/* ============================================================================================ */
+} } // namespace lrtaudio::events
+/* ============================================================================================ */
+
+#endif // LRTAUDIO_EVENTS_HPP
@@ -0,0 +1,347 @@
+#include "kernels.hpp"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    #define LRTAUDIO_KERNELS_X86 1
+#else
+    #define LRTAUDIO_KERNELS_X86 0
+#endif
+
+#if LRTAUDIO_KERNELS_X86 && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #define LRTAUDIO_KERNELS_USE_SSE2 1
+    #include <emmintrin.h>
+#else
+    #define LRTAUDIO_KERNELS_USE_SSE2 0
+#endif
+
+#if LRTAUDIO_KERNELS_X86 && (defined(__GNUC__) || defined(_MSC_VER))
+    #define LRTAUDIO_KERNELS_USE_AVX 1
+    #include <immintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+        #define LRTAUDIO_KERNELS_AVX_TARGET
+    #else
+        #define LRTAUDIO_KERNELS_AVX_TARGET __attribute__((target("avx")))
+    #endif
+#else
+    #define LRTAUDIO_KERNELS_USE_AVX 0
+#endif
+
+using namespace lrtaudio;
+
+/* ============================================================================================ */
+
+struct KernelSet
+{
+    const char* name;
+    void (*clear)     (float* buffer, uint32_t nframes);
+    void (*copy)      (float* dst, const float* src, uint32_t nframes);
+    void (*copyScaled)(float* dst, const float* src, float gain, uint32_t nframes);
+    void (*scale)     (float* buffer, float gain, uint32_t nframes);
+    void (*add)       (float* dst, const float* src, uint32_t nframes);
+    void (*addScaled) (float* dst, const float* src, float gain, uint32_t nframes);
+};
+
+/* ============================================================================================ */
+
+static void scalarClear(float* buffer, uint32_t nframes)
+{
+    memset(buffer, 0, nframes * sizeof(float));
+}
+
+static void scalarCopy(float* dst, const float* src, uint32_t nframes)
+{
+    if (dst != src) {
+        memcpy(dst, src, nframes * sizeof(float));
+    }
+}
+
+static void scalarCopyScaled(float* dst, const float* src, float gain, uint32_t nframes)
+{
+    for (uint32_t i = 0; i < nframes; ++i) {
+        dst[i] = gain * src[i];
+    }
+}
+
+static void scalarScale(float* buffer, float gain, uint32_t nframes)
+{
+    for (uint32_t i = 0; i < nframes; ++i) {
+        buffer[i] *= gain;
+    }
+}
+
+static void scalarAdd(float* dst, const float* src, uint32_t nframes)
+{
+    for (uint32_t i = 0; i < nframes; ++i) {
+        dst[i] += src[i];
+    }
+}
+
+static void scalarAddScaled(float* dst, const float* src, float gain, uint32_t nframes)
+{
+    for (uint32_t i = 0; i < nframes; ++i) {
+        dst[i] += gain * src[i];
+    }
+}
+
+static const KernelSet scalarKernels =
+{
+    "scalar",
+    scalarClear,
+    scalarCopy,
+    scalarCopyScaled,
+    scalarScale,
+    scalarAdd,
+    scalarAddScaled
+};
+
+/* ============================================================================================ */
+#if LRTAUDIO_KERNELS_USE_SSE2
+/* ============================================================================================ */
+
+static void sse2Clear(float* buffer, uint32_t nframes)
+{
+    const __m128 zero = _mm_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 8 <= nframes; i += 8) {
+        _mm_storeu_ps(buffer + i,     zero);
+        _mm_storeu_ps(buffer + i + 4, zero);
+    }
+    for (; i < nframes; ++i) {
+        buffer[i] = 0;
+    }
+}
+
+static void sse2CopyScaled(float* dst, const float* src, float gain, uint32_t nframes)
+{
+    const __m128 g = _mm_set1_ps(gain);
+    uint32_t i = 0;
+    for (; i + 4 <= nframes; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_mul_ps(g, _mm_loadu_ps(src + i)));
+    }
+    for (; i < nframes; ++i) {
+        dst[i] = gain * src[i];
+    }
+}
+
+static void sse2Scale(float* buffer, float gain, uint32_t nframes)
+{
+    sse2CopyScaled(buffer, buffer, gain, nframes);
+}
+
+static void sse2Add(float* dst, const float* src, uint32_t nframes)
+{
+    uint32_t i = 0;
+    for (; i + 8 <= nframes; i += 8) {
+        _mm_storeu_ps(dst + i,     _mm_add_ps(_mm_loadu_ps(dst + i),     _mm_loadu_ps(src + i)));
+        _mm_storeu_ps(dst + i + 4, _mm_add_ps(_mm_loadu_ps(dst + i + 4), _mm_loadu_ps(src + i + 4)));
+    }
+    for (; i < nframes; ++i) {
+        dst[i] += src[i];
+    }
+}
+
+static void sse2AddScaled(float* dst, const float* src, float gain, uint32_t nframes)
+{
+    const __m128 g = _mm_set1_ps(gain);
+    uint32_t i = 0;
+    for (; i + 4 <= nframes; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i),
+                                          _mm_mul_ps(g, _mm_loadu_ps(src + i))));
+    }
+    for (; i < nframes; ++i) {
+        dst[i] += gain * src[i];
+    }
+}
+
+static const KernelSet sse2Kernels =
+{
+    "sse2",
+    sse2Clear,
+    scalarCopy,
+    sse2CopyScaled,
+    sse2Scale,
+    sse2Add,
+    sse2AddScaled
+};
+
+/* ============================================================================================ */
+#endif // LRTAUDIO_KERNELS_USE_SSE2
+/* ============================================================================================ */
+
+/* ============================================================================================ */
+#if LRTAUDIO_KERNELS_USE_AVX
+/* ============================================================================================ */
+
+LRTAUDIO_KERNELS_AVX_TARGET
+static void avxClear(float* buffer, uint32_t nframes)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 8 <= nframes; i += 8) {
+        _mm256_storeu_ps(buffer + i, zero);
+    }
+    for (; i < nframes; ++i) {
+        buffer[i] = 0;
+    }
+}
+
+LRTAUDIO_KERNELS_AVX_TARGET
+static void avxCopyScaled(float* dst, const float* src, float gain, uint32_t nframes)
+{
+    const __m256 g = _mm256_set1_ps(gain);
+    uint32_t i = 0;
+    for (; i + 8 <= nframes; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(g, _mm256_loadu_ps(src + i)));
+    }
+    for (; i < nframes; ++i) {
+        dst[i] = gain * src[i];
+    }
+}
+
+LRTAUDIO_KERNELS_AVX_TARGET
+static void avxScale(float* buffer, float gain, uint32_t nframes)
+{
+    avxCopyScaled(buffer, buffer, gain, nframes);
+}
+
+LRTAUDIO_KERNELS_AVX_TARGET
+static void avxAdd(float* dst, const float* src, uint32_t nframes)
+{
+    uint32_t i = 0;
+    for (; i + 8 <= nframes; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
+    }
+    for (; i < nframes; ++i) {
+        dst[i] += src[i];
+    }
+}
+
+LRTAUDIO_KERNELS_AVX_TARGET
+static void avxAddScaled(float* dst, const float* src, float gain, uint32_t nframes)
+{
+    const __m256 g = _mm256_set1_ps(gain);
+    uint32_t i = 0;
+    for (; i + 8 <= nframes; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i),
+                                                _mm256_mul_ps(g, _mm256_loadu_ps(src + i))));
+    }
+    for (; i < nframes; ++i) {
+        dst[i] += gain * src[i];
+    }
+}
+
+static const KernelSet avxKernels =
+{
+    "avx",
+    avxClear,
+    scalarCopy,
+    avxCopyScaled,
+    avxScale,
+    avxAdd,
+    avxAddScaled
+};
+
+static bool cpuSupportsAvx()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx     = (info[2] & (1 << 28)) != 0;
+    return osxsave && avx && ((_xgetbv(0) & 6) == 6);
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx");
+#endif
+}
+
+/* ============================================================================================ */
+#endif // LRTAUDIO_KERNELS_USE_AVX
+/* ============================================================================================ */
+
+static const KernelSet* kernelSet = &scalarKernels;
+
+/* ============================================================================================ */
+
+void kernels::init()
+{
+    const KernelSet* k = &scalarKernels;
+#if LRTAUDIO_KERNELS_USE_SSE2
+    k = &sse2Kernels;
+#endif
+#if LRTAUDIO_KERNELS_USE_AVX
+    if (cpuSupportsAvx()) {
+        k = &avxKernels;
+    }
+#endif
+    kernelSet = k;
+}
+
+/* ============================================================================================ */
+
+const char* kernels::get_instruction_set()
+{
+    return kernelSet->name;
+}
+
+void kernels::clear(float* buffer, uint32_t nframes)
+{
+    kernelSet->clear(buffer, nframes);
+}
+
+void kernels::copy(float* dst, const float* src, uint32_t nframes)
+{
+    kernelSet->copy(dst, src, nframes);
+}
+
+void kernels::copy_scaled(float* dst, const float* src, float gain, uint32_t nframes)
+{
+    kernelSet->copyScaled(dst, src, gain, nframes);
+}
+
+void kernels::scale(float* buffer, float gain, uint32_t nframes)
+{
+    kernelSet->scale(buffer, gain, nframes);
+}
+
+void kernels::add(float* dst, const float* src, uint32_t nframes)
+{
+    kernelSet->add(dst, src, nframes);
+}
+
+void kernels::add_scaled(float* dst, const float* src, float gain, uint32_t nframes)
+{
+    kernelSet->addScaled(dst, src, gain, nframes);
+}
+
+/* ============================================================================================ */
+extern "C" {
+/* ============================================================================================ */
+
+static const char* getInstructionSet(void)
+{
+    return kernels::get_instruction_set();
+}
+
+/* ============================================================================================ */
+} // extern "C"
+/* ============================================================================================ */
+
+const auproc_kernels_capi kernels::capi_impl =
+{
+    AUPROC_KERNELS_CAPI_VERSION_MAJOR,
+    AUPROC_KERNELS_CAPI_VERSION_MINOR,
+    AUPROC_KERNELS_CAPI_VERSION_PATCH,
+
+    NULL, /* next_capi */
+
+    getInstructionSet,
+    kernels::clear,
+    kernels::copy,
+    kernels::copy_scaled,
+    kernels::scale,
+    kernels::add,
+    kernels::add_scaled
+};
+
+/* ============================================================================================ */
@@ -0,0 +1,33 @@
+#ifndef LRTAUDIO_KERNELS_HPP
+#define LRTAUDIO_KERNELS_HPP
+
+#include "util.h"
+#include "auproc_kernels_capi.h"
+
+/* ============================================================================================ */
+namespace lrtaudio {
+namespace kernels {
+/* ============================================================================================ */
+
+/**
+ * Selects the kernel implementations for the instruction set of the
+ * current CPU. Is called when the module is loaded.
+ */
+void init();
+
+const char* get_instruction_set();
+
+void clear      (float* buffer, uint32_t nframes);
+void copy       (float* dst, const float* src, uint32_t nframes);
+void copy_scaled(float* dst, const float* src, float gain, uint32_t nframes);
+void scale      (float* buffer, float gain, uint32_t nframes);
+void add        (float* dst, const float* src, uint32_t nframes);
+void add_scaled (float* dst, const float* src, float gain, uint32_t nframes);
+
+extern const auproc_kernels_capi capi_impl;
+
+/* ============================================================================================ */
+} } // namespace lrtaudio::kernels
+/* ============================================================================================ */
+
+#endif // LRTAUDIO_KERNELS_HPP
@@ -4,6 +4,7 @@
 #include "main.hpp"
 #include "controller.hpp"
 #include "error.hpp"
+#include "kernels.hpp"
 
 #define RECEIVER_CAPI_IMPLEMENT_GET_CAPI 1
 #include "receiver_capi.h"
@@ -367,6 +368,7 @@ DLL_PUBLIC int luaopen_lrtaudio(lua_State* L)
     
     lua_checkstack(L, LUA_MINSTACK);
     
+    lrtaudio::kernels::init();
     lrtaudio_controller_init_module(L, module);
 
     lua_settop(L, module);
@@ -0,0 +1,569 @@
+#include "main.hpp"
+#include "controller.hpp"
+#include "stream.hpp"
+#include "procbuf.hpp"
+#include "midiport.hpp"
+#include "auproc_capi_impl.hpp"
+
+using namespace lrtaudio;
+
+/* ============================================================================================ */
+
+#if defined(LRTAUDIO_USE_ALSA_MIDI)
+
+/* ============================================================================================ */
+
+static const char* const MIDI_INPUT_PROCESSOR_NAME  = "lrtaudio.MidiInput";
+static const char* const MIDI_OUTPUT_PROCESSOR_NAME = "lrtaudio.MidiOutput";
+
+static const int      RING_SIZE        = 64 * 1024;  // bytes, power of 2
+static const size_t   MAX_SYSEX_SIZE   = 4096;       // longer system exclusive messages are dropped
+static const size_t   READ_SIZE        = 256;
+static const int      MAX_POLL_FDS     = 4;
+static const int      POLL_MILLIS      = 10;
+static const uint64_t WRITE_POLL_NANOS = 1000000;
+
+/* ============================================================================================ */
+
+static void ringRead(MidiPort* port, unsigned index, void* dest, size_t size)
+{
+    unsigned       mask = port->ringSize - 1;
+    unsigned char* d    = (unsigned char*) dest;
+    for (size_t i = 0; i < size; ++i) {
+        d[i] = port->ring[(index + i) & mask];
+    }
+}
+
+static void ringWrite(MidiPort* port, unsigned index, const void* src, size_t size)
+{
+    unsigned             mask = port->ringSize - 1;
+    const unsigned char* s    = (const unsigned char*) src;
+    for (size_t i = 0; i < size; ++i) {
+        port->ring[(index + i) & mask] = s[i];
+    }
+}
+
+/**
+ * Queues an event, must only be called by the producer of the ring.
+ */
+static bool pushEvent(MidiPort* port, uint64_t nanos, const unsigned char* data, size_t size)
+{
+    unsigned w = (unsigned) atomic_get(&port->writeIndex);
+    unsigned r = (unsigned) atomic_get(&port->readIndex);
+
+    if (port->ringSize - (w - r) < sizeof(MidiPortEvent) + size) {
+        atomic_inc(&port->droppedEvents);
+        return false;
+    }
+    MidiPortEvent e;
+    memset(&e, 0, sizeof(e));
+    e.nanos = nanos;
+    e.size  = (uint32_t) size;
+    ringWrite(port, w, &e, sizeof(e));
+    ringWrite(port, w + sizeof(e), data, size);
+    atomic_set(&port->writeIndex, (int)(w + sizeof(e) + size));
+    return true;
+}
+
+/* ============================================================================================ */
+
+static int midiInputProcess(uint32_t nframes, void* processorData)
+{
+    MidiPort* port   = (MidiPort*) processorData;
+    Stream*   stream = port->stream;
+
+    const auproc_midimeth* methods = port->conReg.midiMethods;
+    auproc_midibuf*        midibuf = methods->getMidiBuffer(port->conReg.connector, nframes);
+    methods->clearBuffer(midibuf);
+
+    // events that arrived during the previous process cycle are placed at the
+    // corresponding offset in this cycle, i.e. with a constant latency of one cycle.
+    uint64_t begin  = stream->processBeginNanos;
+    uint64_t period = (uint64_t) nframes * 1000000000 / stream->sampleRate;
+    unsigned w      = (unsigned) atomic_get(&port->writeIndex);
+    unsigned r      = (unsigned) atomic_get(&port->readIndex);
+
+    while (w - r >= sizeof(MidiPortEvent)) {
+        MidiPortEvent e;
+        ringRead(port, r, &e, sizeof(e));
+        if ((int64_t)(e.nanos - begin) >= 0) {
+            break; // arrived in this cycle
+        }
+        uint32_t time = 0;
+        if (e.nanos + period > begin) {
+            time = (uint32_t)((e.nanos + period - begin) * stream->sampleRate / 1000000000);
+            if (time >= nframes) {
+                time = nframes - 1;
+            }
+        }
+        unsigned char* data = methods->reserveMidiEvent(midibuf, time, e.size);
+        if (data) {
+            ringRead(port, r + sizeof(e), data, e.size);
+        }
+        r += sizeof(e) + e.size;
+    }
+    atomic_set(&port->readIndex, (int) r);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static int midiOutputProcess(uint32_t nframes, void* processorData)
+{
+    MidiPort* port   = (MidiPort*) processorData;
+    Stream*   stream = port->stream;
+
+    const auproc_midimeth* methods = port->conReg.midiMethods;
+    auproc_midibuf*        midibuf = methods->getMidiBuffer(port->conReg.connector, nframes);
+
+    // events are sent one cycle later, i.e. with the same latency as the
+    // audio output.
+    uint64_t base  = stream->processBeginNanos + (uint64_t) nframes * 1000000000 / stream->sampleRate;
+    uint32_t count = methods->getEventCount(midibuf);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        auproc_midi_event e;
+        if (methods->getMidiEvent(&e, midibuf, i) == 0) {
+            uint64_t nanos = base + (uint64_t) e.time * 1000000000 / stream->sampleRate;
+            pushEvent(port, nanos, e.buffer, e.size);
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+/**
+ * Number of data bytes following the status byte.
+ */
+static size_t dataLength(unsigned char status)
+{
+    if (status < 0xF0) {
+        switch (status & 0xF0) {
+            case 0xC0:
+            case 0xD0: return 1;
+            default:   return 2;
+        }
+    }
+    switch (status) {
+        case 0xF1:
+        case 0xF3: return 1;
+        case 0xF2: return 2;
+        default:   return 0;
+    }
+}
+
+static void pushMessage(MidiPort* port, uint64_t nanos)
+{
+    pushEvent(port, nanos, port->message, port->messageLength);
+    port->messageLength = 0;
+}
+
+static void parseByte(MidiPort* port, unsigned char b, uint64_t nanos)
+{
+    if (b >= 0xF8) {
+        // realtime messages may appear between the bytes of other messages
+        pushEvent(port, nanos, &b, 1);
+        return;
+    }
+    if (port->inSysex) {
+        if (b < 0x80 || b == 0xF7) {
+            if (port->messageLength < MAX_SYSEX_SIZE) {
+                port->message[port->messageLength++] = b;
+            } else {
+                port->sysexOverflow = true;
+            }
+            if (b == 0xF7) {
+                port->inSysex = false;
+                if (port->sysexOverflow) {
+                    atomic_inc(&port->droppedEvents);
+                    port->messageLength = 0;
+                } else {
+                    pushMessage(port, nanos);
+                }
+            }
+            return;
+        }
+        // incomplete system exclusive message is discarded
+        port->inSysex       = false;
+        port->messageLength = 0;
+    }
+    if (b == 0xF7) {
+        return; // end of system exclusive message without begin
+    }
+    if (b == 0xF0) {
+        port->inSysex         = true;
+        port->sysexOverflow   = false;
+        port->runningStatus   = 0;
+        port->message[0]      = b;
+        port->messageLength   = 1;
+        return;
+    }
+    if (b & 0x80) {
+        port->runningStatus   = (b < 0xF0) ? b : 0;
+        port->message[0]      = b;
+        port->messageLength   = 1;
+        port->messageExpected = 1 + dataLength(b);
+    }
+    else {
+        if (port->messageLength == 0) {
+            if (!port->runningStatus) {
+                return;
+            }
+            port->message[0]      = port->runningStatus;
+            port->messageLength   = 1;
+            port->messageExpected = 1 + dataLength(port->runningStatus);
+        }
+        port->message[port->messageLength++] = b;
+    }
+    if (port->messageLength == port->messageExpected) {
+        pushMessage(port, nanos);
+    }
+}
+
+/* ============================================================================================ */
+
+static void readerMain(void* arg)
+{
+    MidiPort* port = (MidiPort*) arg;
+
+    struct pollfd fds[MAX_POLL_FDS];
+    int count = snd_rawmidi_poll_descriptors_count(port->rawmidi);
+    if (count > MAX_POLL_FDS) {
+        count = MAX_POLL_FDS;
+    }
+    count = snd_rawmidi_poll_descriptors(port->rawmidi, fds, count);
+
+    unsigned char buffer[READ_SIZE];
+
+    while (!atomic_get(&port->shutdown)) {
+        int rc = poll(fds, count, POLL_MILLIS);
+        if (rc < 0 && errno != EINTR) {
+            port->ioError = errno;
+            break;
+        }
+        if (rc <= 0) {
+            continue;
+        }
+        while (true) {
+            ssize_t n = snd_rawmidi_read(port->rawmidi, buffer, sizeof(buffer));
+            if (n == -EAGAIN || n == 0) {
+                break;
+            }
+            if (n < 0) {
+                port->ioError = (int) -n;
+                return;
+            }
+            uint64_t nanos = async_monotonic_nanos();
+            for (ssize_t i = 0; i < n; ++i) {
+                parseByte(port, buffer[i], nanos);
+            }
+        }
+    }
+}
+
+/* ============================================================================================ */
+
+static void sleepUntil(uint64_t nanos)
+{
+    struct timespec t;
+    t.tv_sec  = nanos / 1000000000;
+    t.tv_nsec = nanos % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR) {}
+}
+
+static bool writeRing(MidiPort* port, unsigned index, size_t size)
+{
+    unsigned mask = port->ringSize - 1;
+    while (size > 0) {
+        unsigned pos   = index & mask;
+        size_t   chunk = port->ringSize - pos;
+        if (chunk > size) {
+            chunk = size;
+        }
+        ssize_t n = snd_rawmidi_write(port->rawmidi, port->ring + pos, chunk);
+        if (n <= 0) {
+            port->ioError = (n < 0) ? (int) -n : EIO;
+            return false;
+        }
+        index += n;
+        size  -= n;
+    }
+    return true;
+}
+
+static void writerMain(void* arg)
+{
+    MidiPort* port = (MidiPort*) arg;
+
+    while (true) {
+        bool     shutdown = atomic_get(&port->shutdown);
+        unsigned w        = (unsigned) atomic_get(&port->writeIndex);
+        unsigned r        = (unsigned) atomic_get(&port->readIndex);
+        uint64_t now      = async_monotonic_nanos();
+        if (w == r) {
+            if (shutdown) {
+                break;
+            }
+            sleepUntil(now + WRITE_POLL_NANOS);
+            continue;
+        }
+        MidiPortEvent e;
+        ringRead(port, r, &e, sizeof(e));
+        if (e.nanos > now && !shutdown) {
+            sleepUntil(e.nanos < now + WRITE_POLL_NANOS ? e.nanos : now + WRITE_POLL_NANOS);
+            continue;
+        }
+        if (!port->ioError) {
+            writeRing(port, r + sizeof(e), e.size);
+        }
+        atomic_set(&port->readIndex, (int)(r + sizeof(e) + e.size));
+    }
+    if (!port->ioError) {
+        snd_rawmidi_drain(port->rawmidi);
+    }
+}
+
+/* ============================================================================================ */
+
+/**
+ * Stops the device thread and closes the device.
+ */
+static void finishMidiPort(MidiPort* port)
+{
+    if (port->started) {
+        atomic_set(&port->shutdown, 1);
+        async_thread_join(&port->thread);
+        port->started = false;
+    }
+    if (port->rawmidi) {
+        snd_rawmidi_close(port->rawmidi);
+        port->rawmidi = NULL;
+    }
+}
+
+static void freeMidiPort(MidiPort* port)
+{
+    finishMidiPort(port);
+    free(port->ring);
+    free(port->message);
+    free(port->device);
+    free(port);
+}
+
+/* ============================================================================================ */
+
+static MidiPort* findMidiPort(Stream* stream, const char* device, bool isInput)
+{
+    MidiPort* p = stream->firstMidiPort;
+    while (p) {
+        if (p->isInput == isInput && strcmp(p->device, device) == 0) {
+            return p;
+        }
+        p = p->nextMidiPort;
+    }
+    return NULL;
+}
+
+/* ============================================================================================ */
+
+static const char* regErrorText(auproc_reg_err_type errorType)
+{
+    switch (errorType) {
+        case AUPROC_REG_ERR_ARG_INVALID:          return "not a connector object";
+        case AUPROC_REG_ERR_CONNCTOR_INVALID:     return "connector object is invalid";
+        case AUPROC_REG_ERR_ENGINE_MISMATCH:      return "connector belongs to another stream";
+        case AUPROC_REG_ERR_WRONG_DIRECTION:      return "connector cannot be used as input";
+        case AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE: return "connector is not a MIDI connector";
+        default:                                  return "invalid call";
+    }
+}
+
+/* ============================================================================================ */
+
+static MidiPort* newMidiPort(lua_State* L, Stream* stream, const char* device, bool isInput)
+{
+    if (findMidiPort(stream, device, isInput)) {
+        luaL_error(L, "MIDI %s '%s' already opened", isInput ? "input" : "output", device);
+        return NULL;
+    }
+    MidiPort* port = (MidiPort*) calloc(1, sizeof(MidiPort));
+    if (!port) {
+        luaL_error(L, "out of memory");
+        return NULL;
+    }
+    port->isInput  = isInput;
+    port->stream   = stream;
+    port->ringSize = RING_SIZE;
+    port->ring     = (unsigned char*) malloc(RING_SIZE);
+    port->device   = strdup(device);
+    if (isInput) {
+        port->message = (unsigned char*) malloc(MAX_SYSEX_SIZE);
+    }
+    if (!port->ring || !port->device || (isInput && !port->message)) {
+        freeMidiPort(port);
+        luaL_error(L, "out of memory");
+        return NULL;
+    }
+    memset(port->ring, 0, RING_SIZE); // pre-fault pages
+
+    int rc = isInput ? snd_rawmidi_open(&port->rawmidi, NULL, device, SND_RAWMIDI_NONBLOCK)
+                     : snd_rawmidi_open(NULL, &port->rawmidi, device, 0);
+    if (rc < 0) {
+        port->rawmidi = NULL;
+        freeMidiPort(port);
+        luaL_error(L, "cannot open MIDI device '%s': %s", device, snd_strerror(rc));
+        return NULL;
+    }
+    return port;
+}
+
+static void startMidiPort(lua_State* L, ControllerUserData* ctrlUdata, MidiPort* port)
+{
+    Stream* stream = port->stream;
+
+    port->started = async_thread_start(&port->thread, port->isInput ? readerMain : writerMain, port);
+    if (!port->started) {
+        auproc::capi_impl.unregisterProcessor(L, (auproc_engine*) ctrlUdata, port->processor);
+        freeMidiPort(port);
+        luaL_error(L, "cannot start MIDI device thread");
+        return;
+    }
+    auproc::capi_impl.activateProcessor(L, (auproc_engine*) ctrlUdata, port->processor);
+
+    port->nextMidiPort = stream->firstMidiPort;
+    if (port->nextMidiPort) {
+        port->nextMidiPort->prevNextMidiPort = &port->nextMidiPort;
+    }
+    port->prevNextMidiPort = &stream->firstMidiPort;
+    stream->firstMidiPort = port;
+}
+
+/* ============================================================================================ */
+
+void midiport::open_midi_input(lua_State* L, ControllerUserData* ctrlUdata, const char* device,
+                               size_t midiBufferSize)
+{
+    ProcBufUserData* procBuf = procbuf::push_new_procbuf(L, ctrlUdata, true, midiBufferSize); /* -> procBuf */
+
+    MidiPort* port = newMidiPort(L, ctrlUdata->stream, device, true);
+    port->procBuf  = procBuf;
+
+    port->conReg.conType      = AUPROC_MIDI;
+    port->conReg.conDirection = AUPROC_OUT;
+
+    auproc_con_reg_err regError;
+    port->processor = auproc::capi_impl.registerProcessor(L, lua_gettop(L), 1,
+                                                          (auproc_engine*) ctrlUdata,
+                                                          MIDI_INPUT_PROCESSOR_NAME, port,
+                                                          midiInputProcess, NULL, NULL, NULL,
+                                                          &port->conReg, &regError);
+    if (!port->processor) {
+        freeMidiPort(port);
+        luaL_error(L, "cannot open MIDI input: %s", regErrorText(regError.errorType));
+        return;
+    }
+    startMidiPort(L, ctrlUdata, port);
+}
+
+/* ============================================================================================ */
+
+void midiport::open_midi_output(lua_State* L, ControllerUserData* ctrlUdata, const char* device,
+                                int connectorArg)
+{
+    MidiPort* port = newMidiPort(L, ctrlUdata->stream, device, false);
+
+    port->conReg.conType      = AUPROC_MIDI;
+    port->conReg.conDirection = AUPROC_IN;
+
+    auproc_con_reg_err regError;
+    port->processor = auproc::capi_impl.registerProcessor(L, connectorArg, 1,
+                                                          (auproc_engine*) ctrlUdata,
+                                                          MIDI_OUTPUT_PROCESSOR_NAME, port,
+                                                          midiOutputProcess, NULL, NULL, NULL,
+                                                          &port->conReg, &regError);
+    if (!port->processor) {
+        freeMidiPort(port);
+        luaL_argerror(L, connectorArg, regErrorText(regError.errorType));
+        return;
+    }
+    startMidiPort(L, ctrlUdata, port);
+}
+
+/* ============================================================================================ */
+
+void midiport::close_midi_port(lua_State* L, ControllerUserData* ctrlUdata, const char* device,
+                               bool isInput)
+{
+    Stream*   stream = ctrlUdata->stream;
+    MidiPort* port   = findMidiPort(stream, device, isInput);
+    if (!port) {
+        luaL_error(L, "MIDI %s '%s' not opened", isInput ? "input" : "output", device);
+        return;
+    }
+    // waits until the realtime thread no longer invokes the port
+    auproc::capi_impl.unregisterProcessor(L, (auproc_engine*) ctrlUdata, port->processor);
+
+    *port->prevNextMidiPort = port->nextMidiPort;
+    if (port->nextMidiPort) {
+        port->nextMidiPort->prevNextMidiPort = port->prevNextMidiPort;
+    }
+    finishMidiPort(port);
+
+    lua_Integer dropped = atomic_get(&port->droppedEvents);
+    int         error   = port->ioError;
+    freeMidiPort(port);
+    if (error) {
+        luaL_error(L, "error accessing MIDI device '%s': %s", device, strerror(error));
+        return;
+    }
+    lua_pushinteger(L, dropped);
+}
+
+/* ============================================================================================ */
+
+void midiport::free_midi_ports(Stream* stream)
+{
+    MidiPort* p = stream->firstMidiPort;
+    while (p) {
+        MidiPort* next = p->nextMidiPort;
+        freeMidiPort(p);
+        p = next;
+    }
+    stream->firstMidiPort = NULL;
+}
+
+/* ============================================================================================ */
+
+#else // !LRTAUDIO_USE_ALSA_MIDI
+
+/* ============================================================================================ */
+
+void midiport::open_midi_input(lua_State* L, ControllerUserData* ctrlUdata, const char* device,
+                               size_t midiBufferSize)
+{
+    luaL_error(L, "MIDI devices are not supported on this platform");
+}
+
+void midiport::open_midi_output(lua_State* L, ControllerUserData* ctrlUdata, const char* device,
+                                int connectorArg)
+{
+    luaL_error(L, "MIDI devices are not supported on this platform");
+}
+
+void midiport::close_midi_port(lua_State* L, ControllerUserData* ctrlUdata, const char* device,
+                               bool isInput)
+{
+    luaL_error(L, "MIDI %s '%s' not opened", isInput ? "input" : "output", device);
+}
+
+void midiport::free_midi_ports(Stream* stream)
+{
+    stream->firstMidiPort = NULL;
+}
+
+/* ============================================================================================ */
+
+#endif // LRTAUDIO_USE_ALSA_MIDI
+
+/* ============================================================================================ */
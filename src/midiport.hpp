@@ -0,0 +1,108 @@
+#ifndef LRTAUDIO_MIDIPORT_HPP
+#define LRTAUDIO_MIDIPORT_HPP
+
+#include "util.h"
+#include "auproc_capi.h"
+
+/* ============================================================================================ */
+namespace lrtaudio {
+/* ============================================================================================ */
+
+struct ControllerUserData;
+struct ProcBufUserData;
+struct Stream;
+
+/**
+ * Event in the queue between device thread and realtime thread,
+ * followed by size data bytes.
+ */
+struct MidiPortEvent
+{
+    uint64_t nanos;           // monotonic time of arrival or of the time to send
+    uint32_t size;
+};
+
+/**
+ * MIDI device port. The port is registered as processor with one MIDI
+ * connector. For an input port a reader thread parses the bytes from the
+ * device into events that are timestamped on arrival and passed to the
+ * realtime thread through a single producer single consumer queue. The
+ * processor writes the events that arrived during the previous process
+ * cycle into its MIDI stream buffer at sample offsets that correspond to
+ * their arrival times. For an output port the processor queues the events
+ * of its input connector and a writer thread sends them to the device at
+ * the time given by the sample offset.
+ */
+struct MidiPort
+{
+    auproc_processor* processor;
+    auproc_con_reg    conReg;
+    char*             device;
+    bool              isInput;
+    Stream*           stream;
+    ProcBufUserData*  procBuf;        // stream buffer of an input port
+#if defined(LRTAUDIO_USE_ALSA_MIDI)
+    snd_rawmidi_t*    rawmidi;
+#endif
+
+    unsigned char*    ring;           // MidiPortEvent headers followed by data
+    int               ringSize;       // number of bytes, power of 2
+    AtomicCounter     writeIndex;     // in bytes, wraps around
+    AtomicCounter     readIndex;
+    AtomicCounter     droppedEvents;  // events that did not fit into the ring
+
+    unsigned char*    message;        // incomplete message, only used in reader thread
+    size_t            messageLength;
+    size_t            messageExpected;
+    unsigned char     runningStatus;
+    bool              inSysex;
+    bool              sysexOverflow;
+
+    Thread            thread;
+    bool              started;
+    AtomicCounter     shutdown;
+    int               ioError;        // error code of the first failed device I/O
+
+    MidiPort**        prevNextMidiPort;
+    MidiPort*         nextMidiPort;
+};
+
+/* ============================================================================================ */
+namespace midiport {
+/* ============================================================================================ */
+
+/**
+ * Opens the MIDI input device and pushes a new MIDI stream buffer that
+ * receives the events of the device. midiBufferSize is the size of the
+ * stream buffer, see procbuf::push_new_procbuf.
+ */
+void open_midi_input(lua_State* L, ControllerUserData* ctrlUdata, const char* device,
+                     size_t midiBufferSize);
+
+/**
+ * Opens the MIDI output device and sends the events of the MIDI connector
+ * at connectorArg to the device.
+ */
+void open_midi_output(lua_State* L, ControllerUserData* ctrlUdata, const char* device,
+                      int connectorArg);
+
+/**
+ * Unregisters the port and closes the device. Pushes the number of events
+ * that were dropped because the queue between device thread and realtime
+ * thread was full or because a received system exclusive message was too 
+ * long. Raises a Lua error if accessing the device failed.
+ */
+void close_midi_port(lua_State* L, ControllerUserData* ctrlUdata, const char* device,
+                     bool isInput);
+
+/**
+ * Closes the devices of all ports of the stream. The processors of the
+ * ports are not invoked afterwards because the stream is closed.
+ */
+void free_midi_ports(Stream* stream);
+
+/* ============================================================================================ */
+} } // namespace lrtaudio::midiport
+/* ============================================================================================ */
+
+#endif // LRTAUDIO_MIDIPORT_HPP
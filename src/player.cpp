@@ -0,0 +1,570 @@
+#include "main.hpp"
+#include "controller.hpp"
+#include "stream.hpp"
+#include "player.hpp"
+#include "auproc_capi_impl.hpp"
+
+using namespace lrtaudio;
+using player::PlayerOptions;
+
+/* ============================================================================================ */
+
+static const char* const PLAYER_PROCESSOR_NAME = "lrtaudio.Player";
+
+static const int    COMMAND_CAPACITY = 16;
+static const size_t TOUCH_STEP       = 4096;   // not larger than page size
+static const int    POLL_MILLIS      = 10;
+
+/* ============================================================================================ */
+
+static inline uint32_t getLE32(const char* p)
+{
+    const unsigned char* b = (const unsigned char*) p;
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static inline uint16_t getLE16(const char* p)
+{
+    const unsigned char* b = (const unsigned char*) p;
+    return b[0] | (b[1] << 8);
+}
+
+/* ============================================================================================ */
+
+static void convertSamples(Player* p, float* b, int channel, uint32_t n)
+{
+    size_t      stride = p->channels * p->bytesPerSample;
+    const char* s      = p->sampleData + ((size_t) p->playPosition * p->channels + channel)
+                                         * p->bytesPerSample;
+    switch (p->sampleType) {
+        case PLAYER_INT16:
+            for (uint32_t i = 0; i < n; ++i, s += stride) {
+                b[i] = (int16_t) getLE16(s) * (1.0f / 32768.0f);
+            }
+            break;
+        case PLAYER_INT24:
+            for (uint32_t i = 0; i < n; ++i, s += stride) {
+                const unsigned char* u = (const unsigned char*) s;
+                int32_t v = (int32_t)(((uint32_t)u[0] << 8) | ((uint32_t)u[1] << 16) | ((uint32_t)u[2] << 24));
+                b[i] = (v >> 8) * (1.0f / 8388608.0f);
+            }
+            break;
+        case PLAYER_INT32:
+            for (uint32_t i = 0; i < n; ++i, s += stride) {
+                b[i] = (int32_t) getLE32(s) * (1.0f / 2147483648.0f);
+            }
+            break;
+        case PLAYER_FLOAT32:
+            for (uint32_t i = 0; i < n; ++i, s += stride) {
+                memcpy(b + i, s, sizeof(float));
+            }
+            break;
+    }
+}
+
+/* ============================================================================================ */
+
+static void renderSegment(Player* p, uint32_t from, uint32_t to)
+{
+    while (from < to)
+    {
+        if (!p->playing) {
+            for (int c = 0; c < p->connectorCount; ++c) {
+                if (p->buffers[c]) {
+                    memset(p->buffers[c] + from, 0, (to - from) * sizeof(float));
+                }
+            }
+            return;
+        }
+        int end = p->loop ? p->loopEnd : p->frameCount;
+        if (p->playPosition >= end) {
+            if (p->loop) {
+                p->playPosition = p->loopStart;
+            } else {
+                p->playing = false;
+            }
+            continue;
+        }
+        uint32_t n = to - from;
+        if (n > (uint32_t)(end - p->playPosition)) {
+            n = end - p->playPosition;
+        }
+        for (int c = 0; c < p->connectorCount; ++c) {
+            float* b = p->buffers[c];
+            if (!b) {
+                continue;
+            }
+            if (c < p->channels) {
+                convertSamples(p, b + from, c, n);
+            } else {
+                memset(b + from, 0, n * sizeof(float));
+            }
+        }
+        p->playPosition += n;
+        from            += n;
+    }
+}
+
+/* ============================================================================================ */
+
+static void executeCommand(Player* p, PlayerCommand* cmd)
+{
+    switch (cmd->type) {
+        case PLAYER_START: p->playing = true;  p->playPosition = cmd->position; break;
+        case PLAYER_STOP:  p->playing = false;                                  break;
+        case PLAYER_SEEK:                      p->playPosition = cmd->position; break;
+    }
+}
+
+/* ============================================================================================ */
+
+static int playerProcess(uint32_t nframes, void* processorData)
+{
+    Player* p = (Player*) processorData;
+
+    for (int c = 0; c < p->connectorCount; ++c) {
+        auproc_con_reg* reg = p->conRegs + c;
+        p->buffers[c] = reg->audioMethods->getAudioBuffer(reg->connector, nframes);
+    }
+    uint32_t begin  = p->stream->processBeginFrameTime;
+    uint32_t offset = 0;
+    while (offset < nframes)
+    {
+        uint32_t end = nframes;
+        int      r   = atomic_get(&p->commandReadIndex);
+        if (r != atomic_get(&p->commandWriteIndex)) {
+            PlayerCommand* cmd = p->commands + (r & (p->commandCapacity - 1));
+            int32_t        rel = (int32_t)(cmd->frameTime - begin);
+            if (rel <= (int32_t) offset) {
+                executeCommand(p, cmd);
+                atomic_set(&p->commandReadIndex, r + 1);
+                continue;
+            }
+            if (rel < (int32_t) nframes) {
+                end = rel; // sample accurate
+            }
+        }
+        renderSegment(p, offset, end);
+        offset = end;
+    }
+    atomic_set(&p->position,  p->playPosition);
+    atomic_set(&p->isPlaying, p->playing);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+/**
+ * Reads the pages of the given frame range, i.e. page faults are resolved
+ * outside of the realtime thread.
+ */
+static void touchFrames(Player* p, int from, int to)
+{
+    if (from >= to) {
+        return;
+    }
+    size_t      frameBytes = p->channels * p->bytesPerSample;
+    const char* begin      = p->sampleData + (size_t) from * frameBytes;
+    const char* end        = p->sampleData + (size_t) to   * frameBytes;
+    const char* page       = p->fileData + ((begin - p->fileData) / TOUCH_STEP) * TOUCH_STEP;
+#if !defined(LRTAUDIO_ASYNC_USE_WIN32) && defined(MADV_WILLNEED)
+    madvise((void*) page, end - page, MADV_WILLNEED);
+#endif
+    volatile char sum = 0;
+    for (; page < end; page += TOUCH_STEP) {
+        sum += *page;
+    }
+    sum += *(end - 1);
+}
+
+static void prefetch(Player* p, int position, int frames)
+{
+    int end = p->loop ? p->loopEnd : p->frameCount;
+    if (position < 0 || position > end) {
+        position = p->loop ? p->loopStart : end;
+    }
+    int to = (frames < end - position) ? position + frames : end;
+    touchFrames(p, position, to);
+    int remaining = frames - (to - position);
+    if (p->loop && remaining > 0) {
+        int loopLength = p->loopEnd - p->loopStart;
+        touchFrames(p, p->loopStart, p->loopStart + (remaining < loopLength ? remaining : loopLength));
+    }
+}
+
+/* ============================================================================================ */
+
+static void readAheadMain(void* arg)
+{
+    Player* p = (Player*) arg;
+
+    while (!atomic_get(&p->shutdown)) {
+        if (atomic_get(&p->isPlaying)) {
+            prefetch(p, atomic_get(&p->position), p->readAheadFrames);
+        }
+        async_sleep_millis(POLL_MILLIS);
+    }
+}
+
+/* ============================================================================================ */
+
+static bool mapFile(Player* p, const char* path)
+{
+#if defined(LRTAUDIO_ASYNC_USE_WIN32)
+    p->fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL, NULL);
+    if (p->fileHandle == INVALID_HANDLE_VALUE) {
+        p->fileHandle = NULL;
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(p->fileHandle, &size) || size.QuadPart == 0) {
+        return false;
+    }
+    p->mappingHandle = CreateFileMappingA(p->fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!p->mappingHandle) {
+        return false;
+    }
+    p->fileData = (const char*) MapViewOfFile(p->mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    p->fileSize = (size_t) size.QuadPart;
+    return p->fileData != NULL;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    int err = (fstat(fd, &st) != 0) ? errno : (st.st_size == 0) ? EINVAL : 0;
+    if (err) {
+        close(fd);
+        errno = err;
+        return false;
+    }
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    p->fileData = (const char*) data;
+    p->fileSize = st.st_size;
+    return true;
+#endif
+}
+
+static void unmapFile(Player* p)
+{
+#if defined(LRTAUDIO_ASYNC_USE_WIN32)
+    if (p->fileData)      UnmapViewOfFile(p->fileData);
+    if (p->mappingHandle) CloseHandle(p->mappingHandle);
+    if (p->fileHandle)    CloseHandle(p->fileHandle);
+    p->mappingHandle = NULL;
+    p->fileHandle    = NULL;
+#else
+    if (p->fileData) {
+        munmap((void*) p->fileData, p->fileSize);
+    }
+#endif
+    p->fileData = NULL;
+}
+
+/* ============================================================================================ */
+
+/**
+ * Returns error message or NULL on success.
+ */
+static const char* parseWav(Player* p)
+{
+    const char* data = p->fileData;
+    size_t      size = p->fileSize;
+
+    if (size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0) {
+        return "not a WAVE file";
+    }
+    int    formatTag     = 0;
+    int    bitsPerSample = 0;
+    size_t dataOffset    = 0;
+    size_t dataSize      = 0;
+    size_t offset        = 12;
+    while (offset + 8 <= size)
+    {
+        const char* chunk = data + offset;
+        size_t      body  = offset + 8;
+        size_t      csize = getLE32(chunk + 4);
+        if (memcmp(chunk, "fmt ", 4) == 0 && csize >= 16 && body + csize <= size) {
+            formatTag         = getLE16(data + body);
+            p->channels       = getLE16(data + body + 2);
+            p->fileSampleRate = getLE32(data + body + 4);
+            bitsPerSample     = getLE16(data + body + 14);
+            if (formatTag == 0xfffe && csize >= 40) {
+                formatTag = getLE16(data + body + 24); // sub format
+            }
+        }
+        else if (memcmp(chunk, "data", 4) == 0) {
+            dataOffset = body;
+            dataSize   = (csize < size - body) ? csize : size - body;
+            break;
+        }
+        offset = body + csize + (csize & 1);
+    }
+    if (dataOffset == 0 || p->channels < 1) {
+        return "invalid WAVE file";
+    }
+         if (formatTag == 1 && bitsPerSample == 16) p->sampleType = PLAYER_INT16;
+    else if (formatTag == 1 && bitsPerSample == 24) p->sampleType = PLAYER_INT24;
+    else if (formatTag == 1 && bitsPerSample == 32) p->sampleType = PLAYER_INT32;
+    else if (formatTag == 3 && bitsPerSample == 32) p->sampleType = PLAYER_FLOAT32;
+    else {
+        return "unsupported WAVE sample format";
+    }
+    p->bytesPerSample = bitsPerSample / 8;
+    p->sampleData     = data + dataOffset;
+    size_t frames     = dataSize / (p->channels * p->bytesPerSample);
+    p->frameCount     = frames < 0x7fffffff ? (int) frames : 0x7fffffff;
+    return NULL;
+}
+
+static const char* parseRaw(Player* p, int channels)
+{
+    p->channels       = channels;
+    p->sampleType     = PLAYER_FLOAT32;
+    p->bytesPerSample = sizeof(float);
+    p->sampleData     = p->fileData;
+    size_t frames     = p->fileSize / (channels * sizeof(float));
+    p->frameCount     = frames < 0x7fffffff ? (int) frames : 0x7fffffff;
+    return NULL;
+}
+
+/* ============================================================================================ */
+
+static void freePlayer(Player* p)
+{
+    if (p->started) {
+        atomic_set(&p->shutdown, 1);
+        async_thread_join(&p->thread);
+        p->started = false;
+    }
+    unmapFile(p);
+    free(p->commands);
+    free(p->buffers);
+    free(p->conRegs);
+    free(p->path);
+    free(p);
+}
+
+/* ============================================================================================ */
+
+static Player* findPlayer(Stream* stream, const char* path)
+{
+    Player* p = stream->firstPlayer;
+    while (p) {
+        if (strcmp(p->path, path) == 0) {
+            return p;
+        }
+        p = p->nextPlayer;
+    }
+    return NULL;
+}
+
+static Player* checkPlayer(lua_State* L, Stream* stream, const char* path)
+{
+    Player* p = findPlayer(stream, path);
+    if (!p) {
+        luaL_error(L, "not playing file '%s'", path);
+    }
+    return p;
+}
+
+/* ============================================================================================ */
+
+static void pushCommand(lua_State* L, Player* p, PlayerCommandType type, uint32_t frameTime,
+                        int position)
+{
+    int w = atomic_get(&p->commandWriteIndex);
+    if (w - atomic_get(&p->commandReadIndex) >= p->commandCapacity) {
+        luaL_error(L, "too many pending playback commands");
+        return;
+    }
+    PlayerCommand* cmd = p->commands + (w & (p->commandCapacity - 1));
+    cmd->type      = type;
+    cmd->frameTime = frameTime;
+    cmd->position  = position;
+    atomic_set(&p->commandWriteIndex, w + 1);
+}
+
+/* ============================================================================================ */
+
+static const char* regErrorText(auproc_reg_err_type errorType)
+{
+    switch (errorType) {
+        case AUPROC_REG_ERR_ARG_INVALID:          return "not a connector object";
+        case AUPROC_REG_ERR_CONNCTOR_INVALID:     return "connector object is invalid";
+        case AUPROC_REG_ERR_ENGINE_MISMATCH:      return "connector belongs to another stream";
+        case AUPROC_REG_ERR_WRONG_DIRECTION:      return "connector cannot be used as output";
+        case AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE: return "connector is not an audio connector";
+        default:                                  return "invalid call";
+    }
+}
+
+/* ============================================================================================ */
+
+void player::start_playback(lua_State* L, ControllerUserData* ctrlUdata, const char* path,
+                            int connectorsArg, const PlayerOptions* options)
+{
+    Stream* stream = ctrlUdata->stream;
+
+    if (findPlayer(stream, path)) {
+        luaL_error(L, "already playing file '%s'", path);
+        return;
+    }
+    int top = lua_gettop(L);
+    int connectorCount;
+    if (lua_type(L, connectorsArg) == LUA_TTABLE) {
+        connectorCount = (int) lua_rawlen(L, connectorsArg);
+        luaL_checkstack(L, connectorCount, NULL);
+        for (int i = 1; i <= connectorCount; ++i) {
+            lua_rawgeti(L, connectorsArg, i);
+        }
+    } else {
+        connectorCount = 1;
+        lua_pushvalue(L, connectorsArg);
+    }
+    if (connectorCount < 1) {
+        luaL_argerror(L, connectorsArg, "connector list must not be empty");
+        return;
+    }
+    Player* p = (Player*) calloc(1, sizeof(Player));
+    if (!p) {
+        luaL_error(L, "out of memory");
+        return;
+    }
+    p->stream          = stream;
+    p->connectorCount  = connectorCount;
+    p->commandCapacity = COMMAND_CAPACITY;
+    p->conRegs         = (auproc_con_reg*) calloc(connectorCount, sizeof(auproc_con_reg));
+    p->buffers         = (float**)         calloc(connectorCount, sizeof(float*));
+    p->commands        = (PlayerCommand*)  calloc(COMMAND_CAPACITY, sizeof(PlayerCommand));
+    p->path            = strdup(path);
+    if (!p->conRegs || !p->buffers || !p->commands || !p->path) {
+        freePlayer(p);
+        luaL_error(L, "out of memory");
+        return;
+    }
+    for (int i = 0; i < connectorCount; ++i) {
+        p->conRegs[i].conType      = AUPROC_AUDIO;
+        p->conRegs[i].conDirection = AUPROC_OUT;
+    }
+    if (!mapFile(p, path)) {
+        int err = errno;
+        freePlayer(p);
+        luaL_error(L, "cannot open file '%s': %s", path, strerror(err));
+        return;
+    }
+    const char* errorText = options->rawChannels > 0 ? parseRaw(p, options->rawChannels)
+                                                     : parseWav(p);
+    if (!errorText) {
+        p->loop      = options->loop;
+        p->loopStart = options->loopStart;
+        p->loopEnd   = (options->loopEnd < 0 || options->loopEnd > p->frameCount) ? p->frameCount
+                                                                                 : options->loopEnd;
+        if (p->loop && p->loopStart >= p->loopEnd) {
+            errorText = "invalid loop range";
+        }
+    }
+    if (errorText) {
+        freePlayer(p);
+        luaL_error(L, "cannot play file '%s': %s", path, errorText);
+        return;
+    }
+    if (p->fileSampleRate != 0 && p->fileSampleRate != stream->sampleRate) {
+        lrtaudio::log_info("lrtaudio: sample rate of file '%s' differs from stream sample rate", path);
+    }
+    p->readAheadFrames = (int)(options->readAheadSeconds * stream->sampleRate);
+    prefetch(p, options->position, p->readAheadFrames);
+
+    auproc_con_reg_err regError;
+    p->processor = auproc::capi_impl.registerProcessor(L, top + 1, connectorCount,
+                                                       (auproc_engine*) ctrlUdata,
+                                                       PLAYER_PROCESSOR_NAME, p,
+                                                       playerProcess, NULL, NULL, NULL,
+                                                       p->conRegs, &regError);
+    lua_settop(L, top);
+    if (!p->processor) {
+        freePlayer(p);
+        luaL_error(L, "cannot play into connector %d: %s", regError.conIndex + 1,
+                                                          regErrorText(regError.errorType));
+        return;
+    }
+    p->started = async_thread_start(&p->thread, readAheadMain, p);
+    if (!p->started) {
+        auproc::capi_impl.unregisterProcessor(L, (auproc_engine*) ctrlUdata, p->processor);
+        freePlayer(p);
+        luaL_error(L, "cannot start read-ahead thread");
+        return;
+    }
+    uint32_t startTime = options->hasStartTime ? options->startTime : stream->processBeginFrameTime;
+    pushCommand(L, p, PLAYER_START, startTime, options->position);
+
+    auproc::capi_impl.activateProcessor(L, (auproc_engine*) ctrlUdata, p->processor);
+
+    p->nextPlayer = stream->firstPlayer;
+    if (p->nextPlayer) {
+        p->nextPlayer->prevNextPlayer = &p->nextPlayer;
+    }
+    p->prevNextPlayer   = &stream->firstPlayer;
+    stream->firstPlayer = p;
+}
+
+/* ============================================================================================ */
+
+void player::stop_playback(lua_State* L, ControllerUserData* ctrlUdata, const char* path,
+                           bool hasFrameTime, uint32_t frameTime)
+{
+    Player* p = checkPlayer(L, ctrlUdata->stream, path);
+    if (hasFrameTime) {
+        pushCommand(L, p, PLAYER_STOP, frameTime, 0);
+        return;
+    }
+    // waits until the realtime thread no longer invokes the player
+    auproc::capi_impl.unregisterProcessor(L, (auproc_engine*) ctrlUdata, p->processor);
+
+    *p->prevNextPlayer = p->nextPlayer;
+    if (p->nextPlayer) {
+        p->nextPlayer->prevNextPlayer = p->prevNextPlayer;
+    }
+    freePlayer(p);
+}
+
+/* ============================================================================================ */
+
+void player::seek_playback(lua_State* L, ControllerUserData* ctrlUdata, const char* path,
+                           int position, bool hasFrameTime, uint32_t frameTime)
+{
+    Player* p = checkPlayer(L, ctrlUdata->stream, path);
+    prefetch(p, position, p->readAheadFrames);
+    pushCommand(L, p, PLAYER_SEEK, hasFrameTime ? frameTime : ctrlUdata->stream->processBeginFrameTime,
+                position);
+}
+
+/* ============================================================================================ */
+
+void player::push_playback_position(lua_State* L, ControllerUserData* ctrlUdata, const char* path)
+{
+    Player* p = checkPlayer(L, ctrlUdata->stream, path);
+    lua_pushinteger(L, atomic_get(&p->position));
+    lua_pushboolean(L, atomic_get(&p->isPlaying));
+}
+
+/* ============================================================================================ */
+
+void player::free_players(Stream* stream)
+{
+    Player* p = stream->firstPlayer;
+    while (p) {
+        Player* next = p->nextPlayer;
+        freePlayer(p);
+        p = next;
+    }
+    stream->firstPlayer = NULL;
+}
+
+/* ============================================================================================ */
@@ -0,0 +1,141 @@
+#ifndef LRTAUDIO_PLAYER_HPP
+#define LRTAUDIO_PLAYER_HPP
+
+#include "util.h"
+#include "auproc_capi.h"
+
+/* ============================================================================================ */
+namespace lrtaudio {
+/* ============================================================================================ */
+
+struct ControllerUserData;
+struct Stream;
+
+enum PlayerSampleType
+{
+    PLAYER_INT16,
+    PLAYER_INT24,
+    PLAYER_INT32,
+    PLAYER_FLOAT32
+};
+
+enum PlayerCommandType
+{
+    PLAYER_START,       // start playing at position
+    PLAYER_STOP,
+    PLAYER_SEEK         // continue at position
+};
+
+struct PlayerCommand
+{
+    PlayerCommandType type;
+    uint32_t          frameTime;
+    int               position;
+};
+
+/**
+ * Plays an audio file that is memory mapped. The player is registered as
+ * processor that converts the samples directly from the mapped file into
+ * its output connectors. A read-ahead thread keeps the pages following the
+ * current play position resident, so that the realtime thread does not
+ * wait for disk I/O. Commands are passed to the realtime thread through a
+ * single producer single consumer ring and are executed at the frame time
+ * given with the command.
+ */
+struct Player
+{
+    auproc_processor* processor;
+    auproc_con_reg*   conRegs;
+    float**           buffers;        // per connector, used in process cycle
+    int               connectorCount;
+    char*             path;
+    Stream*           stream;
+
+    const char*       fileData;       // mapping of the whole file
+    size_t            fileSize;
+    const char*       sampleData;
+    PlayerSampleType  sampleType;
+    int               bytesPerSample;
+    int               channels;       // channels in file
+    int               frameCount;
+    uint32_t          fileSampleRate;
+#if defined(LRTAUDIO_ASYNC_USE_WIN32)
+    HANDLE            fileHandle;
+    HANDLE            mappingHandle;
+#endif
+
+    bool              loop;
+    int               loopStart;
+    int               loopEnd;
+
+    PlayerCommand*    commands;
+    int               commandCapacity; // power of 2
+    AtomicCounter     commandWriteIndex;
+    AtomicCounter     commandReadIndex;
+
+    bool              playing;        // only used in process cycle
+    int               playPosition;   // only used in process cycle
+    AtomicCounter     position;       // play position after last process cycle
+    AtomicCounter     isPlaying;
+
+    int               readAheadFrames;
+    Thread            thread;
+    bool              started;
+    AtomicCounter     shutdown;
+
+    Player**          prevNextPlayer;
+    Player*           nextPlayer;
+};
+
+/* ============================================================================================ */
+namespace player {
+/* ============================================================================================ */
+
+struct PlayerOptions
+{
+    bool     hasStartTime;
+    uint32_t startTime;
+    int      position;
+    bool     loop;
+    int      loopStart;
+    int      loopEnd;          // -1: end of file
+    int      rawChannels;      // > 0 for raw float files without header
+    double   readAheadSeconds;
+};
+
+/**
+ * Maps the file and starts playing into the connectors that are given as
+ * Lua connector object or list of connector objects at connectorsArg.
+ */
+void start_playback(lua_State* L, ControllerUserData* ctrlUdata, const char* path,
+                    int connectorsArg, const PlayerOptions* options);
+
+/**
+ * Stops the playback at frameTime. If hasFrameTime is false, the player
+ * is unregistered and the file is closed immediately.
+ */
+void stop_playback(lua_State* L, ControllerUserData* ctrlUdata, const char* path,
+                   bool hasFrameTime, uint32_t frameTime);
+
+/**
+ * Continues the playback at position starting with frameTime.
+ */
+void seek_playback(lua_State* L, ControllerUserData* ctrlUdata, const char* path,
+                   int position, bool hasFrameTime, uint32_t frameTime);
+
+/**
+ * Pushes play position and playing state.
+ */
+void push_playback_position(lua_State* L, ControllerUserData* ctrlUdata, const char* path);
+
+/**
+ * Frees all players of the stream. The processors of the players are
+ * not invoked afterwards because the stream is closed.
+ */
+void free_players(Stream* stream);
+
+/* ============================================================================================ */
+} } // namespace lrtaudio::player
+/* ============================================================================================ */
+
+#endif // LRTAUDIO_PLAYER_HPP
@@ -1,4 +1,5 @@
 #define AUPROC_CAPI_IMPLEMENT_SET_CAPI 1
+#define AUPROC_KERNELS_CAPI_IMPLEMENT_SET_CAPI 1
 
 #include "main.hpp"
 #include "controller.hpp"
@@ -6,6 +7,8 @@
 #include "procbuf.hpp"
 #include "auproc_capi.h"
 #include "auproc_capi_impl.hpp"
+#include "kernels.hpp"
+#include "arena.hpp"
 
 using namespace lrtaudio;
 
@@ -23,7 +26,7 @@ void lrtaudio_procbuf_clear_midi_buffer(auproc_midibuf* midibuf)
     
     udata->midiEventCount  = 0;
     if (udata->bufferData) {
-        udata->midiEventsBegin = (auproc_midi_event*)udata->bufferData;
+        udata->midiEventsBegin = (MidiEventRecord*)udata->bufferData;
         udata->midiDataBegin   = udata->bufferData + udata->bufferLength;
     } else {
         udata->midiEventsBegin = NULL;
@@ -35,10 +38,90 @@ void lrtaudio_procbuf_clear_midi_buffer(auproc_midibuf* midibuf)
 
 /* ============================================================================================ */
 
+static inline void getEvent(auproc_midi_event* event, MidiEventRecord* e)
+{
+    event->time   = e->time;
+    event->size   = e->size;
+    event->buffer = (e->size <= MIDI_INLINE_SIZE) ? e->data : (unsigned char*)e + e->offset;
+}
+
+/* ============================================================================================ */
+
+static void mergeMidiEvents(ProcBufUserData* udata, stream::MidiMerge* m)
+{
+    // k-way merge, the number of writers is small. For equal times the
+    // events of earlier sources come first.
+    MidiEventRecord** heads = m->cursors;
+    for (int i = 0; i < m->sourceCount; ++i) {
+        heads[i] = m->sources[i]->midiEventsBegin;
+    }
+    uint32_t n = 0;
+    while (n < m->mergedCapacity) {
+        int best = -1;
+        for (int i = 0; i < m->sourceCount; ++i) {
+            if (   heads[i] < m->sources[i]->midiEventsEnd 
+                && (best < 0 || heads[i]->time < heads[best]->time)) 
+            {
+                best = i;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        m->merged[n++] = heads[best]++;
+    }
+    udata->midiMerged      = m->merged;
+    udata->midiMergedCount = n;
+
+    if ((int) n > atomic_get(&udata->midiMaxEvents)) {
+        atomic_set(&udata->midiMaxEvents, n);
+    }
+}
+
+/**
+ * Merges the events of all writers on the first read in the current
+ * process cycle. Returns false if the stream buffer has only one writer.
+ * Several readers may be invoked in parallel by worker threads: only one
+ * of them merges, the others wait for the result.
+ */
+static bool updateMidiMerge(ProcBufUserData* udata)
+{
+    if (!udata->ctrlUdata || udata->slotOwner) {
+        return false;
+    }
+    Stream* stream = udata->ctrlUdata->stream;
+    int     epoch  = atomic_get(&stream->processEpoch);
+    if (atomic_get(&udata->midiMergedEpoch) != epoch) {
+        int started = atomic_get(&udata->midiMergingEpoch);
+        if (started != epoch && atomic_set_if_equal(&udata->midiMergingEpoch, started, epoch)) {
+            udata->midiMerged      = NULL;
+            udata->midiMergedCount = 0;
+            stream::ProcList* list = stream->processList;
+            for (int i = 0; list && i < list->midiMergeCount; ++i) {
+                if (list->midiMerges[i].target == udata) {
+                    mergeMidiEvents(udata, list->midiMerges + i);
+                    break;
+                }
+            }
+            atomic_set(&udata->midiMergedEpoch, epoch);
+        } else {
+            while (atomic_get(&udata->midiMergedEpoch) != epoch) {
+                async_cpu_relax(); // merge is done by another reader
+            }
+        }
+    }
+    return udata->midiMerged != NULL;
+}
+
+/* ============================================================================================ */
+
 uint32_t lrtaudio_procbuf_get_midi_event_count(auproc_midibuf* midibuf)
 {
     ProcBufUserData* udata = (ProcBufUserData*) midibuf;
 
+    if (updateMidiMerge(udata)) {
+        return udata->midiMergedCount;
+    }
     return udata->midiEventCount;
 }
 
@@ -50,9 +133,17 @@ int lrtaudio_procbuf_get_midi_event(auproc_midi_event*  event,
 {
     ProcBufUserData* udata = (ProcBufUserData*) midibuf;
 
-    auproc_midi_event* e = udata->midiEventsBegin + event_index;
+    if (updateMidiMerge(udata)) {
+        if (event_index < udata->midiMergedCount) {
+            getEvent(event, udata->midiMerged[event_index]);
+            return 0;
+        } else {
+            return ENODATA;
+        }
+    }
+    MidiEventRecord* e = udata->midiEventsBegin + event_index;
     if (e < udata->midiEventsEnd) {
-        *event = *e;
+        getEvent(event, e);
         return 0;
     } else {
         return ENODATA;
@@ -67,19 +158,45 @@ unsigned char* lrtaudio_procbuf_reserve_midi_event(auproc_midibuf*  midibuf,
 {
     ProcBufUserData* udata = (ProcBufUserData*) midibuf;
 
-    auproc_midi_event* e = udata->midiEventsEnd;
-    unsigned char* eBuf = udata->midiDataBegin - data_size;
-    if ((unsigned char*)(e + 1) <= eBuf) {
-        e->time = time;
-        e->size = data_size;
-        e->buffer = eBuf;
-        udata->midiEventsEnd += 1;
-        udata->midiDataBegin = eBuf;
-        udata->midiEventCount += 1;
-        return eBuf;
-    } else {
+    bool             isInline = (data_size <= MIDI_INLINE_SIZE);
+    size_t           needed   = isInline ? 0 : data_size;
+    MidiEventRecord* e        = udata->midiEventsEnd;
+    if (   udata->midiDataBegin < (unsigned char*)(e + 1)
+        || (size_t)(udata->midiDataBegin - (unsigned char*)(e + 1)) < needed)
+    {
+        atomic_inc(&(udata->slotOwner ? udata->slotOwner : udata)->midiDroppedEvents);
         return NULL;
     }
+    unsigned char* eBuf = udata->midiDataBegin - needed;
+
+    // insertion sort: events are usually reserved in order, i.e. nothing is moved
+    while (e > udata->midiEventsBegin && (e - 1)->time > time) {
+        *e = *(e - 1);
+        if (e->size > MIDI_INLINE_SIZE) {
+            e->offset -= sizeof(MidiEventRecord);
+        }
+        --e;
+    }
+    e->time = time;
+    e->size = (uint32_t) data_size;
+    if (isInline) {
+        eBuf = e->data;
+    } else {
+        e->offset = (uint32_t)(eBuf - (unsigned char*)e);
+        udata->midiDataBegin = eBuf;
+    }
+    udata->midiEventsEnd += 1;
+    udata->midiEventCount += 1;
+    
+    if (!udata->slotOwner && (int) udata->midiEventCount > atomic_get(&udata->midiMaxEvents)) {
+        atomic_set(&udata->midiMaxEvents, udata->midiEventCount);
+    }
+    ProcBufUserData* stats = udata->slotOwner ? udata->slotOwner : udata;
+    int used = (int)(udata->bufferLength - (udata->midiDataBegin - (unsigned char*)udata->midiEventsEnd));
+    if (used > atomic_get(&stats->midiMaxBytes)) {
+        atomic_set(&stats->midiMaxBytes, used);
+    }
+    return eBuf;
 }
 
 /* ============================================================================================ */
@@ -97,7 +214,8 @@ static int pushProcBufMeta(lua_State* L)
 } // extern "C"
 /* ============================================================================================ */
 
-ProcBufUserData* procbuf::push_new_procbuf(lua_State* L, ControllerUserData* ctrlUdata, bool isMidi)
+ProcBufUserData* procbuf::push_new_procbuf(lua_State* L, ControllerUserData* ctrlUdata, bool isMidi,
+                                           size_t midiBufferSize)
 {
     ProcBufUserData* udata = (ProcBufUserData*) lua_newuserdata(L, sizeof(ProcBufUserData));
     memset(udata, 0, sizeof(ProcBufUserData));              /* -> udata */
@@ -119,12 +237,11 @@ ProcBufUserData* procbuf::push_new_procbuf(lua_State* L, ControllerUserData* ctr
     stream->firstProcBufUserData = udata;
     
     {
-        size_t size = isMidi ? (8192 * sizeof(float))
+        size_t size = isMidi ? midiBufferSize
                              : (stream->bufferFrames * sizeof(float));
-        udata->bufferData = (unsigned char*) malloc(size);
+        udata->bufferData = (unsigned char*) arena::alloc_buffer(stream->arena, size);
         
         if (udata->bufferData) {
-            // TODO mlock?
             udata->bufferLength = size;
             procbuf::clear_midi_events(udata);
         } else {
@@ -140,8 +257,9 @@ ProcBufUserData* procbuf::push_new_procbuf(lua_State* L, ControllerUserData* ctr
 void procbuf::release_procbuf(lua_State* L, ProcBufUserData* udata)
 {
     if (udata->bufferData) {
-        free(udata->bufferData);
-        udata->bufferData = NULL;
+        arena::free_buffer(udata->ctrlUdata->stream->arena, udata->bufferData, udata->bufferLength);
+        udata->bufferData   = NULL;
+        udata->bufferLength = 0;
     }
     if (udata->prevNextProcBufUserData) {
         *udata->prevNextProcBufUserData = udata->nextProcBufUserData;
@@ -162,7 +280,7 @@ void procbuf::clear_midi_events(ProcBufUserData* udata)
 {
     udata->midiEventCount  = 0;
     if (udata->bufferData) {
-        udata->midiEventsBegin = (auproc_midi_event*)udata->bufferData;
+        udata->midiEventsBegin = (MidiEventRecord*)udata->bufferData;
         udata->midiDataBegin   = udata->bufferData + udata->bufferLength;
     } else {
         udata->midiEventsBegin = NULL;
@@ -172,6 +290,166 @@ void procbuf::clear_midi_events(ProcBufUserData* udata)
     udata->midiDataEnd   = udata->midiDataBegin;
 }
 
+/* ============================================================================================ */
+
+size_t procbuf::default_midi_buffer_size(uint32_t bufferFrames)
+{
+    size_t size = bufferFrames * sizeof(MidiEventRecord) + DEFAULT_MIDI_DATA_SIZE;
+    return size > MIN_DEFAULT_MIDI_BUFFER_SIZE ? size : MIN_DEFAULT_MIDI_BUFFER_SIZE;
+}
+
+/* ============================================================================================ */
+
+static void swapMidiBuffers(MidiResize* r)
+{
+    for (int i = 0; i < r->count; ++i) {
+        ProcBufUserData* b      = r->buffers[i];
+        unsigned char*   data   = b->bufferData;
+        size_t           length = b->bufferLength;
+        b->bufferData   = r->data[i];
+        b->bufferLength = r->lengths[i];
+        r->data[i]      = data;
+        r->lengths[i]   = length;
+        procbuf::clear_midi_events(b);
+    }
+}
+
+void procbuf::apply_midi_resize(Stream* stream)
+{
+    MidiResize* r = (MidiResize*) atomic_get_ptr(&stream->pendingMidiResize);
+    if (r && atomic_set_ptr_if_equal(&stream->pendingMidiResize, r, NULL)) {
+        swapMidiBuffers(r);
+        atomic_set(&r->applied, 1);
+    }
+}
+
+/* ============================================================================================ */
+
+static void freeMidiResize(Stream* stream, MidiResize* r)
+{
+    for (int i = 0; i < r->count; ++i) {
+        if (r->data[i]) {
+            arena::free_buffer(stream->arena, r->data[i], r->lengths[i]);
+        }
+    }
+    free(r->buffers);
+    free(r->data);
+    free(r->lengths);
+}
+
+/**
+ * true if process cycles are invoked by another thread, i.e. not only
+ * synchronously by render_offline.
+ */
+static bool hasRealtimeThread(Stream* stream)
+{
+    return stream->isRunning && (!stream->isOffline || stream->virtualDevice);
+}
+
+void procbuf::resize_midi_buffer(lua_State* L, ProcBufUserData* udata, size_t newSize)
+{
+    Stream*           stream = udata->ctrlUdata->stream;
+    stream::ProcList* list   = stream->procRegList;
+
+    int slotCount = 0;
+    for (int i = 0; list && i < list->count; ++i) {
+        stream::ProcReg* reg = list->regs[i];
+        for (int j = 0; j < reg->connectorCount; ++j) {
+            ProcBufUserData* slot = reg->connectorInfos[j].slotMidi;
+            if (slot && slot->slotOwner == udata) {
+                slotCount += 1;
+            }
+        }
+    }
+    MidiResize r;
+    memset(&r, 0, sizeof(r));
+    r.buffers = (ProcBufUserData**) calloc(slotCount + 1, sizeof(ProcBufUserData*));
+    r.data    = (unsigned char**)   calloc(slotCount + 1, sizeof(unsigned char*));
+    r.lengths = (size_t*)           calloc(slotCount + 1, sizeof(size_t));
+    if (!r.buffers || !r.data || !r.lengths) {
+        freeMidiResize(stream, &r);
+        luaL_error(L, "out of memory");
+        return;
+    }
+    r.buffers[r.count++] = udata;
+    for (int i = 0; list && i < list->count; ++i) {
+        stream::ProcReg* reg = list->regs[i];
+        for (int j = 0; j < reg->connectorCount; ++j) {
+            ProcBufUserData* slot = reg->connectorInfos[j].slotMidi;
+            if (slot && slot->slotOwner == udata) {
+                r.buffers[r.count++] = slot;
+            }
+        }
+    }
+    for (int i = 0; i < r.count; ++i) {
+        r.data[i]    = (unsigned char*) arena::alloc_buffer(stream->arena, newSize);
+        r.lengths[i] = newSize;
+        if (!r.data[i]) {
+            freeMidiResize(stream, &r);
+            luaL_error(L, "error allocating process buffer");
+            return;
+        }
+    }
+    if (!hasRealtimeThread(stream)) {
+        swapMidiBuffers(&r);
+    } else {
+        atomic_set_ptr(&stream->pendingMidiResize, &r);
+        while (!atomic_get(&r.applied)) {
+            if (   (!hasRealtimeThread(stream) || atomic_get(&stream->shutdownReceived))
+                && atomic_set_ptr_if_equal(&stream->pendingMidiResize, &r, NULL))
+            {
+                swapMidiBuffers(&r); // no longer processed
+                break;
+            }
+            async_sleep_millis(1); // at most until begin of next process cycle
+        }
+    }
+    freeMidiResize(stream, &r); // old buffers
+
+    if (slotCount > 0) {
+        // capacity of the merged event list depends on the buffer sizes
+        stream::ProcList* newList = stream::new_proc_list(stream->procRegList, NULL, NULL);
+        if (!newList) {
+            luaL_error(L, "out of memory");
+            return;
+        }
+        stream::update_proc_list(stream, newList);
+    }
+}
+
+/* ============================================================================================ */
+
+ProcBufUserData* procbuf::new_midi_slot(ProcBufUserData* owner)
+{
+    Stream* stream = owner->ctrlUdata->stream;
+
+    ProcBufUserData* slot = (ProcBufUserData*) calloc(1, sizeof(ProcBufUserData));
+    if (!slot) {
+        return NULL;
+    }
+    slot->ctrlUdata  = owner->ctrlUdata;
+    slot->isMidi     = true;
+    slot->slotOwner  = owner;
+    slot->bufferData = (unsigned char*) arena::alloc_buffer(stream->arena, owner->bufferLength);
+    if (!slot->bufferData) {
+        free(slot);
+        return NULL;
+    }
+    slot->bufferLength = owner->bufferLength;
+    procbuf::clear_midi_events(slot);
+    return slot;
+}
+
+/* ============================================================================================ */
+
+void procbuf::free_midi_slot(Stream* stream, ProcBufUserData* slot)
+{
+    if (slot->bufferData) {
+        arena::free_buffer(stream->arena, slot->bufferData, slot->bufferLength);
+    }
+    free(slot);
+}
+
 /* ============================================================================================ */
 extern "C" {
 /* ============================================================================================ */
@@ -211,8 +489,63 @@ static ProcBufUserData* checkProcBufUdata(lua_State* L, int arg)
 
 /* ============================================================================================ */
 
+static int ProcBuf_getMidiStats(lua_State* L)
+{
+    ProcBufUserData* udata = checkProcBufUdata(L, 1);
+    bool             reset = lua_toboolean(L, 2);
+    if (!udata->isMidi) {
+        return luaL_argerror(L, 1, "not a MIDI stream buffer");
+    }
+    int dropped  = atomic_get(&udata->midiDroppedEvents);
+    int maximum  = atomic_get(&udata->midiMaxEvents);
+    int maxBytes = atomic_get(&udata->midiMaxBytes);
+    if (reset) {
+        while (!atomic_set_if_equal(&udata->midiDroppedEvents, dropped, 0)) {
+            dropped = atomic_get(&udata->midiDroppedEvents);
+        }
+        atomic_set(&udata->midiMaxEvents, 0);
+        atomic_set(&udata->midiMaxBytes, 0);
+    }
+    lua_newtable(L);
+    lua_pushinteger(L, udata->bufferLength);
+    lua_setfield(L, -2, "size");
+    lua_pushinteger(L, dropped);
+    lua_setfield(L, -2, "droppedEvents");
+    lua_pushinteger(L, maximum);
+    lua_setfield(L, -2, "maxEvents");
+    lua_pushinteger(L, maxBytes);
+    lua_setfield(L, -2, "maxBytes");
+    return 1;
+}
+
+/* ============================================================================================ */
+
+static int ProcBuf_setMidiBufferSize(lua_State* L)
+{
+    try {
+        ProcBufUserData* udata = checkProcBufUdata(L, 1);
+        lua_Integer      size  = luaL_checkinteger(L, 2);
+        if (!udata->isMidi) {
+            return luaL_argerror(L, 1, "not a MIDI stream buffer");
+        }
+        if (size < (lua_Integer) procbuf::MIN_MIDI_BUFFER_SIZE || size > 0x7fffffff) {
+            return luaL_argerror(L, 2, "invalid MIDI buffer size");
+        }
+        stream::check_not_closed(L, udata->ctrlUdata);
+        if ((size_t) size != udata->bufferLength) {
+            procbuf::resize_midi_buffer(L, udata, (size_t) size);
+        }
+        return 0;
+    }
+    catch (...) { return lrtaudio::handleException(L); }
+}
+
+/* ============================================================================================ */
+
 static const luaL_Reg ProcBufMethods[] = 
 {
+    { "getMidiStats",      ProcBuf_getMidiStats      },
+    { "setMidiBufferSize", ProcBuf_setMidiBufferSize },
     { NULL,       NULL } /* sentinel */
 };
 
@@ -237,6 +570,7 @@ static void setupProcBufMeta(lua_State* L)
     luaL_setfuncs(L, ProcBufMethods, 0);           /* -> meta, ProcBufClass */
     lua_setfield (L, -2, "__index");             /* -> meta */
     auproc_set_capi(L, -1, &auproc::capi_impl);
+    auproc_kernels_set_capi(L, -1, &kernels::capi_impl);
 }
 
 /* ============================================================================================ */
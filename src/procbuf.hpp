@@ -11,6 +11,23 @@ namespace lrtaudio {
 /* ============================================================================================ */
 
 struct ControllerUserData;
+struct Stream;
+
+static const uint32_t MIDI_INLINE_SIZE = 4;
+
+/**
+ * Event in a MIDI stream buffer. The data of short events is stored in the 
+ * event itself, longer data is stored at the end of the buffer.
+ */
+struct MidiEventRecord
+{
+    uint32_t time;
+    uint32_t size;
+    union {
+        unsigned char data[MIDI_INLINE_SIZE];  // if size <= MIDI_INLINE_SIZE
+        uint32_t      offset;                  // of the data relative to this event otherwise
+    };
+};
 
 struct ProcBufUserData
 {
@@ -29,27 +46,90 @@ struct ProcBufUserData
     
     unsigned char*       bufferData;
     size_t               bufferLength;
+    
+    AtomicPtr            aliasSource;   // stream::ConnectorInfo of a route source whose buffer is used instead
 
     uint32_t           midiEventCount;
-    auproc_midi_event* midiEventsBegin;
-    auproc_midi_event* midiEventsEnd;
+    MidiEventRecord*   midiEventsBegin;     // sorted by time, in reserve order for equal times
+    MidiEventRecord*   midiEventsEnd;
     unsigned char*     midiDataBegin;
     unsigned char*     midiDataEnd;
+    AtomicCounter      midiDroppedEvents;   // events that did not fit into the buffer
+    AtomicCounter      midiMaxEvents;       // maximal number of events in one cycle
+    AtomicCounter      midiMaxBytes;        // maximal number of used bytes in one cycle
+
+    ProcBufUserData*     slotOwner;         // stream buffer if this is the own buffer of an additional writer
+    AtomicCounter        midiMergingEpoch;  // Stream::processEpoch of the cycle the merge was started in
+    AtomicCounter        midiMergedEpoch;   // Stream::processEpoch of the cycle the merge was finished in
+    MidiEventRecord**    midiMerged;        // NULL if the buffer has only one writer in the current cycle
+    uint32_t             midiMergedCount;
     
     ProcBufUserData**    prevNextProcBufUserData;
     ProcBufUserData*     nextProcBufUserData;
 };
 
+/**
+ * Buffers of a MIDI stream buffer and of its additional writers that are
+ * replaced at the begin of a process cycle.
+ */
+struct MidiResize
+{
+    int               count;
+    ProcBufUserData** buffers;
+    unsigned char**   data;      // new buffers, old buffers after the resize was applied
+    size_t*           lengths;
+    AtomicCounter     applied;
+};
+
 /* ============================================================================================ */
 namespace procbuf {
 /* ============================================================================================ */
 
-ProcBufUserData* push_new_procbuf(lua_State* L, ControllerUserData* ctrlUdata, bool isMidi);
+static const size_t MIN_MIDI_BUFFER_SIZE         = 256;
+static const size_t MIN_DEFAULT_MIDI_BUFFER_SIZE = 8192 * sizeof(float);
+static const size_t DEFAULT_MIDI_DATA_SIZE       = 1024;  // for events that are not stored inline
+
+/**
+ * Default number of bytes for MIDI buffers: one short event per frame
+ * and DEFAULT_MIDI_DATA_SIZE for longer events, but at least 
+ * MIN_DEFAULT_MIDI_BUFFER_SIZE.
+ */
+size_t default_midi_buffer_size(uint32_t bufferFrames);
+
+/**
+ * midiBufferSize is the number of bytes for events and event data of
+ * MIDI buffers.
+ */
+ProcBufUserData* push_new_procbuf(lua_State* L, ControllerUserData* ctrlUdata, bool isMidi,
+                                  size_t midiBufferSize);
 
 void release_procbuf(lua_State* L, ProcBufUserData* udata);
 
 void clear_midi_events(ProcBufUserData* udata);
 
+/**
+ * Replaces the buffers of the MIDI stream buffer and of its additional 
+ * writers by buffers of newSize bytes. If a realtime thread is invoking
+ * process cycles, the buffers are exchanged by the realtime thread at the
+ * begin of the next process cycle. The events of the current process
+ * cycle are discarded.
+ */
+void resize_midi_buffer(lua_State* L, ProcBufUserData* udata, size_t newSize);
+
+/**
+ * Invoked by the realtime thread at the begin of each process cycle.
+ */
+void apply_midi_resize(Stream* stream);
+
+/**
+ * Returns the own buffer for an additional writer of the MIDI stream 
+ * buffer owner or NULL if out of memory. The buffer has the same size as 
+ * the buffer of the owner.
+ */
+ProcBufUserData* new_midi_slot(ProcBufUserData* owner);
+
+void free_midi_slot(Stream* stream, ProcBufUserData* slot);
+
 /* ============================================================================================ */
 } } // namespace lrtaudio::procbuf
 /* ============================================================================================ */
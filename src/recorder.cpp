@@ -0,0 +1,546 @@
+#include "main.hpp"
+#include "controller.hpp"
+#include "stream.hpp"
+#include "recorder.hpp"
+#include "auproc_capi_impl.hpp"
+
+#if defined(LRTAUDIO_ASYNC_USE_WIN32)
+    #include <io.h>
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <malloc.h>
+#endif
+
+using namespace lrtaudio;
+
+/* ============================================================================================ */
+
+static const char* const RECORDER_PROCESSOR_NAME = "lrtaudio.Recorder";
+
+static const size_t BLOCK_SIZE      = 1024 * 1024;  // bytes per file write
+static const size_t BLOCK_ALIGNMENT = 4096;         // sufficient for O_DIRECT
+static const int    POLL_MILLIS     = 10;
+
+static const size_t MAX_HEADER_SIZE = 128;
+
+/* ============================================================================================ */
+
+static int recorderProcess(uint32_t nframes, void* processorData)
+{
+    Recorder* rec = (Recorder*) processorData;
+
+    int      channels = rec->channelCount;
+    uint32_t samples  = nframes * channels;
+    unsigned w        = (unsigned) atomic_get(&rec->writeIndex);
+    unsigned r        = (unsigned) atomic_get(&rec->readIndex);
+
+    if (rec->ringSize - (w - r) < samples) {
+        atomic_set(&rec->droppedFrames, atomic_get(&rec->droppedFrames) + nframes);
+        return 0;
+    }
+    for (int c = 0; c < channels; ++c) {
+        auproc_con_reg* reg = rec->conRegs + c;
+        rec->buffers[c] = reg->audioMethods->getAudioBuffer(reg->connector, nframes);
+    }
+    float*   ring = rec->ring;
+    unsigned mask = rec->ringSize - 1;
+    for (uint32_t i = 0; i < nframes; ++i) {
+        for (int c = 0; c < channels; ++c) {
+            float* b = rec->buffers[c];
+            ring[w & mask] = b ? b[i] : 0.0f;
+            ++w;
+        }
+    }
+    atomic_set(&rec->writeIndex, (int) w);
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static char* allocBlock()
+{
+#if defined(LRTAUDIO_ASYNC_USE_WIN32)
+    return (char*) _aligned_malloc(BLOCK_SIZE, BLOCK_ALIGNMENT);
+#else
+    void* ptr = NULL;
+    if (posix_memalign(&ptr, BLOCK_ALIGNMENT, BLOCK_SIZE) != 0) {
+        return NULL;
+    }
+    return (char*) ptr;
+#endif
+}
+
+static void freeBlock(char* block)
+{
+#if defined(LRTAUDIO_ASYNC_USE_WIN32)
+    _aligned_free(block);
+#else
+    free(block);
+#endif
+}
+
+/* ============================================================================================ */
+
+static int openFile(const char* path, bool* directIO)
+{
+#if defined(LRTAUDIO_ASYNC_USE_WIN32)
+    *directIO = false;
+    return _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+  #if defined(O_DIRECT)
+    if (*directIO) {
+        int fd = open(path, flags | O_DIRECT, 0666);
+        if (fd >= 0 || errno != EINVAL) {
+            return fd;
+        }
+        // file system does not support direct I/O
+    }
+  #endif
+    *directIO = false;
+    return open(path, flags, 0666);
+#endif
+}
+
+static bool writeFile(int fd, const char* data, size_t size)
+{
+    while (size > 0) {
+#if defined(LRTAUDIO_ASYNC_USE_WIN32)
+        int n = _write(fd, data, (unsigned int) size);
+#else
+        ssize_t n = write(fd, data, size);
+#endif
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool writeFileAt(int fd, uint64_t offset, const char* data, size_t size)
+{
+#if defined(LRTAUDIO_ASYNC_USE_WIN32)
+    if (_lseeki64(fd, (__int64) offset, SEEK_SET) < 0) {
+        return false;
+    }
+    return writeFile(fd, data, size);
+#else
+    while (size > 0) {
+        ssize_t n = pwrite(fd, data, size, (off_t) offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data   += n;
+        size   -= n;
+        offset += n;
+    }
+    return true;
+#endif
+}
+
+static void closeFile(int fd)
+{
+#if defined(LRTAUDIO_ASYNC_USE_WIN32)
+    _close(fd);
+#else
+    close(fd);
+#endif
+}
+
+/**
+ * Unaligned writes are possible afterwards.
+ */
+static void disableDirectIO(Recorder* rec)
+{
+#if defined(O_DIRECT) && !defined(LRTAUDIO_ASYNC_USE_WIN32)
+    if (rec->directIO) {
+        int flags = fcntl(rec->fd, F_GETFL);
+        if (flags != -1) {
+            fcntl(rec->fd, F_SETFL, flags & ~O_DIRECT);
+        }
+        rec->directIO = false;
+    }
+#endif
+}
+
+/* ============================================================================================ */
+
+static char* putBytes(char* p, const char* bytes, size_t n)
+{
+    memcpy(p, bytes, n);
+    return p + n;
+}
+
+static char* putLE(char* p, uint64_t v, int n)
+{
+    for (int i = 0; i < n; ++i) {
+        *p++ = (char)((v >> (8 * i)) & 0xff);
+    }
+    return p;
+}
+
+static char* putBE(char* p, uint64_t v, int n)
+{
+    for (int i = n - 1; i >= 0; --i) {
+        *p++ = (char)((v >> (8 * i)) & 0xff);
+    }
+    return p;
+}
+
+/**
+ * Writes the file header for the given data size into header, returns
+ * the header size. The header size does not depend on dataBytes and is
+ * a multiple of the sample size.
+ */
+static size_t buildHeader(Recorder* rec, char* header, uint64_t dataBytes)
+{
+    char*    p          = header;
+    uint32_t channels   = rec->channelCount;
+    uint32_t frameBytes = 4 * channels;
+    uint64_t frames     = dataBytes / frameBytes;
+
+    switch (rec->format) {
+        case RECORDER_WAV: {
+            static const char FLOAT_GUID[16] = { 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+                                                 (char)0x80, 0x00, 0x00, (char)0xaa, 0x00, 0x38,
+                                                 (char)0x9b, 0x71 };
+            uint32_t fmtSize    = 40;
+            uint64_t riffSize   = 4 + (8 + fmtSize) + (8 + 4) + (8 + dataBytes);
+            uint32_t dataSize   = (uint32_t) dataBytes;
+            if (riffSize > 0xffffffff) {
+                riffSize = 0xffffffff; // exceeds limit of WAVE format
+                dataSize = 0xffffffff;
+                frames   = 0xffffffff;
+            }
+            p = putBytes(p, "RIFF", 4);
+            p = putLE   (p, riffSize, 4);
+            p = putBytes(p, "WAVE", 4);
+            p = putBytes(p, "fmt ", 4);
+            p = putLE   (p, fmtSize, 4);
+            p = putLE   (p, 0xfffe, 2);                         // WAVE_FORMAT_EXTENSIBLE
+            p = putLE   (p, channels, 2);
+            p = putLE   (p, rec->sampleRate, 4);
+            p = putLE   (p, rec->sampleRate * frameBytes, 4);
+            p = putLE   (p, frameBytes, 2);
+            p = putLE   (p, 32, 2);
+            p = putLE   (p, 22, 2);
+            p = putLE   (p, 32, 2);
+            p = putLE   (p, 0, 4);                              // no channel mask
+            p = putBytes(p, FLOAT_GUID, 16);
+            p = putBytes(p, "fact", 4);
+            p = putLE   (p, 4, 4);
+            p = putLE   (p, frames, 4);
+            p = putBytes(p, "data", 4);
+            p = putLE   (p, dataSize, 4);
+            break;
+        }
+        case RECORDER_CAF: {
+            union { double d; uint64_t u; } rate;
+            rate.d = rec->sampleRate;
+            p = putBytes(p, "caff", 4);
+            p = putBE   (p, 1, 2);                              // file version
+            p = putBE   (p, 0, 2);
+            p = putBytes(p, "desc", 4);
+            p = putBE   (p, 32, 8);
+            p = putBE   (p, rate.u, 8);
+            p = putBytes(p, "lpcm", 4);
+            p = putBE   (p, 1 | 2, 4);                          // float, little endian
+            p = putBE   (p, frameBytes, 4);
+            p = putBE   (p, 1, 4);
+            p = putBE   (p, channels, 4);
+            p = putBE   (p, 32, 4);
+            p = putBytes(p, "data", 4);
+            p = putBE   (p, dataBytes + 4, 8);
+            p = putBE   (p, 0, 4);                              // edit count
+            break;
+        }
+        case RECORDER_RAW:
+            break;
+    }
+    return p - header;
+}
+
+/* ============================================================================================ */
+
+static void writeBlock(Recorder* rec, size_t size)
+{
+    if (!rec->writeError && !writeFile(rec->fd, rec->block, size)) {
+        rec->writeError = errno ? errno : EIO;
+    }
+    rec->fileSize += size;
+    rec->blockFill = 0;
+}
+
+static void drainRing(Recorder* rec)
+{
+    unsigned r     = (unsigned) atomic_get(&rec->readIndex);
+    unsigned avail = (unsigned) atomic_get(&rec->writeIndex) - r;
+    unsigned mask  = rec->ringSize - 1;
+
+    while (avail > 0) {
+        unsigned idx   = r & mask;
+        unsigned n     = avail;
+        unsigned space = (BLOCK_SIZE - rec->blockFill) / sizeof(float);
+        if (n > rec->ringSize - idx) n = rec->ringSize - idx;
+        if (n > space)               n = space;
+
+        memcpy(rec->block + rec->blockFill, rec->ring + idx, n * sizeof(float));
+        rec->blockFill += n * sizeof(float);
+        rec->dataBytes += n * sizeof(float);
+        r     += n;
+        avail -= n;
+        atomic_set(&rec->readIndex, (int) r);
+
+        if (rec->blockFill == BLOCK_SIZE) {
+            writeBlock(rec, BLOCK_SIZE);
+        }
+    }
+}
+
+static void finishFile(Recorder* rec)
+{
+    disableDirectIO(rec);
+    if (rec->blockFill > 0) {
+        writeBlock(rec, rec->blockFill);
+    }
+    if (rec->headerSize > 0 && !rec->writeError) {
+        char   header[MAX_HEADER_SIZE];
+        size_t size = buildHeader(rec, header, rec->dataBytes);
+        if (!writeFileAt(rec->fd, 0, header, size)) {
+            rec->writeError = errno ? errno : EIO;
+        }
+    }
+    closeFile(rec->fd);
+    rec->fd = -1;
+}
+
+/* ============================================================================================ */
+
+static void writerMain(void* arg)
+{
+    Recorder* rec = (Recorder*) arg;
+
+    while (true) {
+        bool shutdown = atomic_get(&rec->shutdown);
+        drainRing(rec);
+        if (shutdown) {
+            break;
+        }
+        async_sleep_millis(POLL_MILLIS);
+    }
+}
+
+/* ============================================================================================ */
+
+/**
+ * Stops the writer thread and completes the file.
+ */
+static void finishRecorder(Recorder* rec)
+{
+    if (rec->started) {
+        atomic_set(&rec->shutdown, 1);
+        async_thread_join(&rec->thread);
+        rec->started = false;
+    }
+    if (rec->fd >= 0) {
+        finishFile(rec);
+    }
+}
+
+static void freeRecorder(Recorder* rec)
+{
+    finishRecorder(rec);
+    if (rec->block) freeBlock(rec->block);
+    free(rec->ring);
+    free(rec->buffers);
+    free(rec->conRegs);
+    free(rec->path);
+    free(rec);
+}
+
+/* ============================================================================================ */
+
+static Recorder* findRecorder(Stream* stream, const char* path)
+{
+    Recorder* r = stream->firstRecorder;
+    while (r) {
+        if (strcmp(r->path, path) == 0) {
+            return r;
+        }
+        r = r->nextRecorder;
+    }
+    return NULL;
+}
+
+/* ============================================================================================ */
+
+static const char* regErrorText(auproc_reg_err_type errorType)
+{
+    switch (errorType) {
+        case AUPROC_REG_ERR_ARG_INVALID:          return "not a connector object";
+        case AUPROC_REG_ERR_CONNCTOR_INVALID:     return "connector object is invalid";
+        case AUPROC_REG_ERR_ENGINE_MISMATCH:      return "connector belongs to another stream";
+        case AUPROC_REG_ERR_WRONG_DIRECTION:      return "connector cannot be used as input";
+        case AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE: return "connector is not an audio connector";
+        default:                                  return "invalid call";
+    }
+}
+
+/* ============================================================================================ */
+
+void recorder::start_recording(lua_State* L, ControllerUserData* ctrlUdata, const char* path,
+                               int connectorsArg, RecorderFormat format, double bufferSeconds,
+                               bool directIO)
+{
+    Stream* stream = ctrlUdata->stream;
+
+    if (findRecorder(stream, path)) {
+        luaL_error(L, "already recording into file '%s'", path);
+        return;
+    }
+    int top = lua_gettop(L);
+    int channelCount;
+    if (lua_type(L, connectorsArg) == LUA_TTABLE) {
+        channelCount = (int) lua_rawlen(L, connectorsArg);
+        luaL_checkstack(L, channelCount, NULL);
+        for (int i = 1; i <= channelCount; ++i) {
+            lua_rawgeti(L, connectorsArg, i);
+        }
+    } else {
+        channelCount = 1;
+        lua_pushvalue(L, connectorsArg);
+    }
+    if (channelCount < 1) {
+        luaL_argerror(L, connectorsArg, "connector list must not be empty");
+        return;
+    }
+    uint64_t ringSamples = (uint64_t)(bufferSeconds * stream->sampleRate) * channelCount;
+    uint64_t ringSize    = 1;
+    while (ringSize < ringSamples && ringSize < (1 << 30)) {
+        ringSize <<= 1;
+    }
+    if (ringSize < (uint64_t) stream->bufferFrames * channelCount) {
+        luaL_error(L, "recording buffer too small");
+        return;
+    }
+    Recorder* rec = (Recorder*) calloc(1, sizeof(Recorder));
+    if (!rec) {
+        luaL_error(L, "out of memory");
+        return;
+    }
+    rec->fd           = -1;
+    rec->channelCount = channelCount;
+    rec->format       = format;
+    rec->sampleRate   = stream->sampleRate;
+    rec->ringSize     = (int) ringSize;
+    rec->conRegs      = (auproc_con_reg*) calloc(channelCount, sizeof(auproc_con_reg));
+    rec->buffers      = (float**)         calloc(channelCount, sizeof(float*));
+    rec->ring         = (float*)          malloc(ringSize * sizeof(float));
+    rec->block        = allocBlock();
+    rec->path         = strdup(path);
+    if (!rec->conRegs || !rec->buffers || !rec->ring || !rec->block || !rec->path) {
+        freeRecorder(rec);
+        luaL_error(L, "out of memory");
+        return;
+    }
+    memset(rec->ring, 0, ringSize * sizeof(float)); // pre-fault pages
+    for (int i = 0; i < channelCount; ++i) {
+        rec->conRegs[i].conType      = AUPROC_AUDIO;
+        rec->conRegs[i].conDirection = AUPROC_IN;
+    }
+
+    rec->directIO = directIO;
+    rec->fd       = openFile(path, &rec->directIO);
+    if (rec->fd < 0) {
+        int err = errno;
+        freeRecorder(rec);
+        luaL_error(L, "cannot open file '%s': %s", path, strerror(err));
+        return;
+    }
+    rec->headerSize = buildHeader(rec, rec->block, 0);
+    rec->blockFill  = rec->headerSize;
+
+    auproc_con_reg_err regError;
+    rec->processor = auproc::capi_impl.registerProcessor(L, top + 1, channelCount,
+                                                         (auproc_engine*) ctrlUdata,
+                                                         RECORDER_PROCESSOR_NAME, rec,
+                                                         recorderProcess, NULL, NULL, NULL,
+                                                         rec->conRegs, &regError);
+    lua_settop(L, top);
+    if (!rec->processor) {
+        freeRecorder(rec);
+        remove(path);
+        luaL_error(L, "cannot record connector %d: %s", regError.conIndex + 1,
+                                                        regErrorText(regError.errorType));
+        return;
+    }
+    rec->started = async_thread_start(&rec->thread, writerMain, rec);
+    if (!rec->started) {
+        auproc::capi_impl.unregisterProcessor(L, (auproc_engine*) ctrlUdata, rec->processor);
+        freeRecorder(rec);
+        luaL_error(L, "cannot start writer thread");
+        return;
+    }
+    auproc::capi_impl.activateProcessor(L, (auproc_engine*) ctrlUdata, rec->processor);
+
+    rec->nextRecorder = stream->firstRecorder;
+    if (rec->nextRecorder) {
+        rec->nextRecorder->prevNextRecorder = &rec->nextRecorder;
+    }
+    rec->prevNextRecorder = &stream->firstRecorder;
+    stream->firstRecorder = rec;
+}
+
+/* ============================================================================================ */
+
+void recorder::stop_recording(lua_State* L, ControllerUserData* ctrlUdata, const char* path)
+{
+    Stream*   stream = ctrlUdata->stream;
+    Recorder* rec    = findRecorder(stream, path);
+    if (!rec) {
+        luaL_error(L, "not recording into file '%s'", path);
+        return;
+    }
+    // waits until the realtime thread no longer invokes the recorder
+    auproc::capi_impl.unregisterProcessor(L, (auproc_engine*) ctrlUdata, rec->processor);
+
+    *rec->prevNextRecorder = rec->nextRecorder;
+    if (rec->nextRecorder) {
+        rec->nextRecorder->prevNextRecorder = rec->prevNextRecorder;
+    }
+    finishRecorder(rec);
+
+    lua_Integer frames  = rec->dataBytes / (4 * rec->channelCount);
+    lua_Integer dropped = atomic_get(&rec->droppedFrames);
+    int         error   = rec->writeError;
+    freeRecorder(rec);
+    if (error) {
+        luaL_error(L, "error writing file '%s': %s", path, strerror(error));
+        return;
+    }
+    lua_pushinteger(L, frames);
+    lua_pushinteger(L, dropped);
+}
+
+/* ============================================================================================ */
+
+void recorder::free_recorders(Stream* stream)
+{
+    Recorder* r = stream->firstRecorder;
+    while (r) {
+        Recorder* next = r->nextRecorder;
+        finishRecorder(r);
+        if (r->writeError) {
+            lrtaudio::log_error("lrtaudio: error writing file '%s': %s", r->path, strerror(r->writeError));
+        }
+        freeRecorder(r);
+        r = next;
+    }
+    stream->firstRecorder = NULL;
+}
+
+/* ============================================================================================ */
@@ -0,0 +1,93 @@
+#ifndef LRTAUDIO_RECORDER_HPP
+#define LRTAUDIO_RECORDER_HPP
+
+#include "util.h"
+#include "auproc_capi.h"
+
+/* ============================================================================================ */
+namespace lrtaudio {
+/* ============================================================================================ */
+
+struct ControllerUserData;
+struct Stream;
+
+enum RecorderFormat
+{
+    RECORDER_WAV,       // 32-bit float WAVE file, limited to 4 GiB
+    RECORDER_CAF,       // 32-bit float Core Audio Format file
+    RECORDER_RAW        // interleaved 32-bit float samples without header
+};
+
+/**
+ * Records audio connectors into a file. The recorder is registered as
+ * processor that interleaves the samples of its input connectors into a
+ * preallocated single producer single consumer ring. A writer thread
+ * transfers the samples from the ring into large aligned blocks that are
+ * written to the file, i.e. the realtime thread never performs file I/O.
+ * If the ring is full, the frames of the process cycle are dropped.
+ */
+struct Recorder
+{
+    auproc_processor* processor;
+    auproc_con_reg*   conRegs;
+    float**           buffers;        // per connector, used in process cycle
+    int               channelCount;
+    char*             path;
+    RecorderFormat    format;
+    uint32_t          sampleRate;
+
+    float*            ring;
+    int               ringSize;       // number of samples, power of 2
+    AtomicCounter     writeIndex;     // in samples, wraps around
+    AtomicCounter     readIndex;
+    AtomicCounter     droppedFrames;
+
+    int               fd;
+    bool              directIO;
+    char*             block;          // aligned staging buffer for file writes
+    size_t            blockFill;
+    size_t            headerSize;
+    uint64_t          fileSize;
+    uint64_t          dataBytes;
+    int               writeError;     // errno of the first failed write
+
+    Thread            thread;
+    bool              started;
+    AtomicCounter     shutdown;
+
+    Recorder**        prevNextRecorder;
+    Recorder*         nextRecorder;
+};
+
+/* ============================================================================================ */
+namespace recorder {
+/* ============================================================================================ */
+
+/**
+ * Creates the file and starts recording the connectors that are given as
+ * Lua connector object or list of connector objects at connectorsArg.
+ * bufferSeconds is the capacity of the ring. If directIO is set, the file
+ * is opened for unbuffered I/O where supported.
+ */
+void start_recording(lua_State* L, ControllerUserData* ctrlUdata, const char* path,
+                     int connectorsArg, RecorderFormat format, double bufferSeconds,
+                     bool directIO);
+
+/**
+ * Unregisters the recorder, writes all remaining samples and closes the
+ * file. Pushes the number of recorded frames and the number of dropped
+ * frames. Raises a Lua error if writing the file failed.
+ */
+void stop_recording(lua_State* L, ControllerUserData* ctrlUdata, const char* path);
+
+/**
+ * Finishes the files of all recorders and frees them. The processors of
+ * the recorders are not invoked afterwards because the stream is closed.
+ */
+void free_recorders(Stream* stream);
+
+/* ============================================================================================ */
+} } // namespace lrtaudio::recorder
+/* ============================================================================================ */
+
+#endif // LRTAUDIO_RECORDER_HPP
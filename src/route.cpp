@@ -0,0 +1,151 @@
+#include "main.hpp"
+#include "controller.hpp"
+#include "stream.hpp"
+#include "procbuf.hpp"
+#include "route.hpp"
+#include "auproc_capi_impl.hpp"
+#include "kernels.hpp"
+
+using namespace lrtaudio;
+
+/* ============================================================================================ */
+
+static const char* const ROUTE_PROCESSOR_NAME = "lrtaudio.Route";
+
+/* ============================================================================================ */
+
+int route::process(uint32_t nframes, void* processorData)
+{
+    Route* route = (Route*) processorData;
+
+    auproc_con_reg* src = route->conRegs + 0;
+    auproc_con_reg* dst = route->conRegs + 1;
+
+    float* s = src->audioMethods->getAudioBuffer(src->connector, nframes);
+    float* d = dst->audioMethods->getAudioBuffer(dst->connector, nframes);
+
+    if (s && d && s != d) {
+        kernels::copy(d, s, nframes);
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+static Route* findRoute(Stream* stream, void* sourceUdata, void* targetUdata)
+{
+    Route* r = stream->firstRoute;
+    while (r) {
+        if (r->sourceUdata == sourceUdata && r->targetUdata == targetUdata) {
+            return r;
+        }
+        r = r->nextRoute;
+    }
+    return NULL;
+}
+
+/* ============================================================================================ */
+
+static const char* regErrorText(auproc_reg_err_type errorType)
+{
+    switch (errorType) {
+        case AUPROC_REG_ERR_ARG_INVALID:          return "not a connector object";
+        case AUPROC_REG_ERR_CONNCTOR_INVALID:     return "connector object is invalid";
+        case AUPROC_REG_ERR_ENGINE_MISMATCH:      return "connector belongs to another stream";
+        case AUPROC_REG_ERR_WRONG_DIRECTION:      return "wrong connector direction";
+        case AUPROC_REG_ERR_WRONG_CONNECTOR_TYPE: return "connector is not an audio connector";
+        default:                                  return "invalid call";
+    }
+}
+
+/* ============================================================================================ */
+
+void route::connect(lua_State* L, ControllerUserData* ctrlUdata, int sourceArg, int targetArg)
+{
+    Stream* stream      = ctrlUdata->stream;
+    void*   sourceUdata = lua_touserdata(L, sourceArg);
+    void*   targetUdata = lua_touserdata(L, targetArg);
+
+    if (sourceUdata && findRoute(stream, sourceUdata, targetUdata)) {
+        luaL_error(L, "connectors are already connected");
+        return;
+    }
+    Route* route = (Route*) calloc(1, sizeof(Route));
+    if (!route) {
+        luaL_error(L, "out of memory");
+        return;
+    }
+    route->sourceUdata = sourceUdata;
+    route->targetUdata = targetUdata;
+    route->conRegs[0].conType      = AUPROC_AUDIO;
+    route->conRegs[0].conDirection = AUPROC_IN;
+    route->conRegs[1].conType      = AUPROC_AUDIO;
+    route->conRegs[1].conDirection = AUPROC_OUT;
+
+    lua_pushvalue(L, sourceArg);                /* -> source */
+    lua_pushvalue(L, targetArg);                /* -> source, target */
+
+    auproc_con_reg_err regError;
+    route->processor = auproc::capi_impl.registerProcessor(L, lua_gettop(L) - 1, 2,
+                                                           (auproc_engine*) ctrlUdata,
+                                                           ROUTE_PROCESSOR_NAME, route,
+                                                           route::process, NULL, NULL, NULL,
+                                                           route->conRegs, &regError);
+    lua_pop(L, 2);                              /* -> */
+    if (!route->processor) {
+        free(route);
+        luaL_error(L, "cannot connect %s: %s", regError.conIndex == 1 ? "target" : "source",
+                                               regErrorText(regError.errorType));
+        return;
+    }
+    auproc::capi_impl.activateProcessor(L, (auproc_engine*) ctrlUdata, route->processor);
+
+    route->nextRoute = stream->firstRoute;
+    if (route->nextRoute) {
+        route->nextRoute->prevNextRoute = &route->nextRoute;
+    }
+    route->prevNextRoute = &stream->firstRoute;
+    stream->firstRoute = route;
+}
+
+/* ============================================================================================ */
+
+void route::disconnect(lua_State* L, ControllerUserData* ctrlUdata, int sourceArg, int targetArg)
+{
+    Stream* stream = ctrlUdata->stream;
+    Route*  route  = findRoute(stream, lua_touserdata(L, sourceArg), lua_touserdata(L, targetArg));
+    if (!route) {
+        luaL_error(L, "connectors are not connected");
+        return;
+    }
+    stream::ConnectorInfo target = ((stream::ProcReg*) route->processor)->connectorInfos[1];
+
+    auproc::capi_impl.unregisterProcessor(L, (auproc_engine*) ctrlUdata, route->processor);
+
+    if (target.isProcBuf) {
+        // the target may not be part of the new list that resets the alias at 
+        // the begin of the next process cycle
+        atomic_set_ptr(&target.procBufUdata->aliasSource, NULL);
+    }
+
+    *route->prevNextRoute = route->nextRoute;
+    if (route->nextRoute) {
+        route->nextRoute->prevNextRoute = route->prevNextRoute;
+    }
+    free(route);
+}
+
+/* ============================================================================================ */
+
+void route::free_routes(Stream* stream)
+{
+    Route* r = stream->firstRoute;
+    while (r) {
+        Route* next = r->nextRoute;
+        free(r);
+        r = next;
+    }
+    stream->firstRoute = NULL;
+}
+
+/* ============================================================================================ */
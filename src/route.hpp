@@ -0,0 +1,56 @@
+#ifndef LRTAUDIO_ROUTE_HPP
+#define LRTAUDIO_ROUTE_HPP
+
+#include "util.h"
+#include "auproc_capi.h"
+
+/* ============================================================================================ */
+namespace lrtaudio {
+/* ============================================================================================ */
+
+struct ControllerUserData;
+struct Stream;
+
+/**
+ * Pass-through connection from an input channel or audio stream buffer
+ * to an output channel or audio stream buffer. A route is registered as
+ * processor, i.e. it is scheduled like any other processor. If the target
+ * is a stream buffer without other writers, the target buffer aliases the
+ * source buffer and the route does not copy any data.
+ */
+struct Route
+{
+    auproc_processor* processor;
+    auproc_con_reg    conRegs[2];   // source, target
+    void*             sourceUdata;
+    void*             targetUdata;
+
+    Route**           prevNextRoute;
+    Route*            nextRoute;
+};
+
+/* ============================================================================================ */
+namespace route {
+/* ============================================================================================ */
+
+void connect(lua_State* L, ControllerUserData* ctrlUdata, int sourceArg, int targetArg);
+
+void disconnect(lua_State* L, ControllerUserData* ctrlUdata, int sourceArg, int targetArg);
+
+/**
+ * Frees all routes of the stream. The processors of the routes are
+ * not invoked afterwards because the stream is closed.
+ */
+void free_routes(Stream* stream);
+
+/**
+ * Process callback of all routes, used for detecting routes in the
+ * list of registered processors.
+ */
+int process(uint32_t nframes, void* processorData);
+
+/* ============================================================================================ */
+} } // namespace lrtaudio::route
+/* ============================================================================================ */
+
+#endif // LRTAUDIO_ROUTE_HPP
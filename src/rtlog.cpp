@@ -0,0 +1,516 @@
+#include "main.hpp"
+#include "rtlog.hpp"
+
+using namespace lrtaudio;
+
+/* ============================================================================================ */
+
+static const int QUEUE_CAPACITY = 64;   // power of 2
+static const int MAX_ARGS       = 8;
+static const int STRING_SPACE   = 256;
+static const int FORMAT_SPACE   = 256;
+static const int MESSAGE_SIZE   = 2048;
+static const int DRAIN_MILLIS   = 10;
+
+/* ============================================================================================ */
+
+enum ArgType
+{
+    ARG_INT,
+    ARG_UINT,
+    ARG_DOUBLE,
+    ARG_STRING,     // offset into LogEntry::strings
+    ARG_POINTER
+};
+
+struct LogArg
+{
+    ArgType type;
+    union {
+        long long          i;
+        unsigned long long u;
+        double             d;
+        const void*        p;
+        int                offset;
+    };
+};
+
+struct LogEntry
+{
+    AtomicCounter  sequence;
+    bool           isError;
+    char           format[FORMAT_SPACE]; // copy, the caller's format string may be freed
+    int            argCount;
+    LogArg         args[MAX_ARGS];
+    char           strings[STRING_SPACE];
+};
+
+/**
+ * Bounded multi producer multi consumer queue, each entry has a sequence
+ * number that tells producers and consumers whether the entry is free or
+ * filled for the current round.
+ */
+struct LogQueue
+{
+    AtomicCounter  initStage;
+    AtomicCounter  drainCount;
+    AtomicCounter  enqueuePos;
+    AtomicCounter  dequeuePos;
+    AtomicCounter  dropped;
+    LogEntry       entries[QUEUE_CAPACITY];
+};
+
+static LogQueue logQueue;
+
+struct lrtaudio::LogDrain
+{
+    Thread         thread;
+    AtomicCounter  shutdown;
+};
+
+/* ============================================================================================ */
+
+enum LengthModifier
+{
+    LEN_NONE,
+    LEN_CHAR,
+    LEN_SHORT,
+    LEN_LONG,
+    LEN_LONGLONG,
+    LEN_SIZE,
+    LEN_INTMAX,
+    LEN_PTRDIFF,
+    LEN_LONGDOUBLE
+};
+
+/**
+ * Conversion specification without the leading '%'.
+ */
+struct FormatSpec
+{
+    const char*    begin;      // flags, width and precision
+    const char*    end;
+    bool           widthStar;
+    bool           precisionStar;
+    LengthModifier length;
+    char           conversion; // 0 if the format string ends within the specification
+};
+
+static const char* parseSpec(const char* p, FormatSpec* spec)
+{
+    spec->widthStar     = false;
+    spec->precisionStar = false;
+    spec->length        = LEN_NONE;
+    spec->begin         = p;
+    while (*p && strchr("-+ #0", *p)) {
+        ++p;
+    }
+    if (*p == '*') {
+        spec->widthStar = true;
+        ++p;
+    } else {
+        while (isdigit((unsigned char)*p)) ++p;
+    }
+    if (*p == '.') {
+        ++p;
+        if (*p == '*') {
+            spec->precisionStar = true;
+            ++p;
+        } else {
+            while (isdigit((unsigned char)*p)) ++p;
+        }
+    }
+    spec->end = p;
+    switch (*p) {
+        case 'h': ++p; if (*p == 'h') { ++p; spec->length = LEN_CHAR; }
+                       else           {      spec->length = LEN_SHORT; }
+                  break;
+        case 'l': ++p; if (*p == 'l') { ++p; spec->length = LEN_LONGLONG; }
+                       else           {      spec->length = LEN_LONG; }
+                  break;
+        case 'z': ++p; spec->length = LEN_SIZE;       break;
+        case 'j': ++p; spec->length = LEN_INTMAX;     break;
+        case 't': ++p; spec->length = LEN_PTRDIFF;    break;
+        case 'L': ++p; spec->length = LEN_LONGDOUBLE; break;
+    }
+    spec->conversion = *p;
+    return *p ? p + 1 : p;
+}
+
+/* ============================================================================================ */
+
+static void captureInt(LogArg* arg, FormatSpec* spec, va_list* args)
+{
+    arg->type = ARG_INT;
+    switch (spec->length) {
+        case LEN_LONG:     arg->i = va_arg(*args, long);      break;
+        case LEN_LONGLONG: arg->i = va_arg(*args, long long); break;
+        case LEN_SIZE:     arg->i = va_arg(*args, size_t);    break;
+        case LEN_INTMAX:   arg->i = va_arg(*args, intmax_t);  break;
+        case LEN_PTRDIFF:  arg->i = va_arg(*args, ptrdiff_t); break;
+        default:           arg->i = va_arg(*args, int);       break;
+    }
+}
+
+static void captureUInt(LogArg* arg, FormatSpec* spec, va_list* args)
+{
+    arg->type = ARG_UINT;
+    switch (spec->length) {
+        case LEN_LONG:     arg->u = va_arg(*args, unsigned long);      break;
+        case LEN_LONGLONG: arg->u = va_arg(*args, unsigned long long); break;
+        case LEN_SIZE:     arg->u = va_arg(*args, size_t);             break;
+        case LEN_INTMAX:   arg->u = va_arg(*args, uintmax_t);          break;
+        case LEN_PTRDIFF:  arg->u = va_arg(*args, ptrdiff_t);          break;
+        case LEN_CHAR:     arg->u = (unsigned char)  va_arg(*args, unsigned int); break;
+        case LEN_SHORT:    arg->u = (unsigned short) va_arg(*args, unsigned int); break;
+        default:           arg->u = va_arg(*args, unsigned int);       break;
+    }
+}
+
+/**
+ * Stores the arguments, must not allocate memory or wait for locks.
+ */
+static void captureArgs(LogEntry* entry, const char* fmt, va_list args)
+{
+    va_list ap;
+    va_copy(ap, args);
+
+    int stringPos = 0;
+    int n         = 0;
+    const char* p = fmt;
+    while (*p && n < MAX_ARGS) {
+        if (*p++ != '%') {
+            continue;
+        }
+        if (*p == '%') {
+            ++p;
+            continue;
+        }
+        FormatSpec spec;
+        p = parseSpec(p, &spec);
+        if (spec.widthStar && n < MAX_ARGS) {
+            entry->args[n].type = ARG_INT;
+            entry->args[n++].i  = va_arg(ap, int);
+        }
+        if (spec.precisionStar && n < MAX_ARGS) {
+            entry->args[n].type = ARG_INT;
+            entry->args[n++].i  = va_arg(ap, int);
+        }
+        if (n >= MAX_ARGS) {
+            break;
+        }
+        LogArg* arg = entry->args + n;
+        switch (spec.conversion) {
+            case 'd': case 'i': case 'c':
+                captureInt(arg, &spec, &ap);
+                break;
+            case 'u': case 'o': case 'x': case 'X':
+                captureUInt(arg, &spec, &ap);
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                arg->type = ARG_DOUBLE;
+                arg->d    = (spec.length == LEN_LONGDOUBLE) ? (double) va_arg(ap, long double)
+                                                            : va_arg(ap, double);
+                break;
+            case 's': {
+                const char* s = va_arg(ap, const char*);
+                if (!s) s = "(null)";
+                size_t len = strlen(s);
+                if (len > (size_t)(STRING_SPACE - 1 - stringPos)) {
+                    len = STRING_SPACE - 1 - stringPos;
+                }
+                memcpy(entry->strings + stringPos, s, len);
+                entry->strings[stringPos + len] = '\0';
+                arg->type   = ARG_STRING;
+                arg->offset = stringPos;
+                stringPos  += (stringPos + len < STRING_SPACE - 1) ? len + 1 : len;
+                break;
+            }
+            case 'p':
+                arg->type = ARG_POINTER;
+                arg->p    = va_arg(ap, void*);
+                break;
+            default:
+                continue; // unsupported conversion, no argument is consumed
+        }
+        ++n;
+    }
+    entry->argCount = n;
+    va_end(ap);
+}
+
+/* ============================================================================================ */
+
+/**
+ * Formats one argument with the conversion specification. Integer arguments
+ * were widened when captured, so the length modifier is replaced.
+ */
+static void appendArg(char* out, int* pos, FormatSpec* spec, LogEntry* entry, int* n)
+{
+    char        specBuffer[64];
+    int         specLength = 0;
+    const char* p          = spec->begin;
+
+    specBuffer[specLength++] = '%';
+    for (; p < spec->end && specLength < (int)sizeof(specBuffer) - 24; ++p) {
+        if (*p == '*') {
+            int value = (*n < entry->argCount) ? (int) entry->args[(*n)++].i : 0;
+            specLength += snprintf(specBuffer + specLength, 16, "%d", value);
+        } else {
+            specBuffer[specLength++] = *p;
+        }
+    }
+    if (*n >= entry->argCount) {
+        return;
+    }
+    LogArg* arg = entry->args + (*n)++;
+    if ((arg->type == ARG_INT || arg->type == ARG_UINT) && spec->conversion != 'c') {
+        specBuffer[specLength++] = 'l';
+        specBuffer[specLength++] = 'l';
+    }
+    specBuffer[specLength++] = spec->conversion;
+    specBuffer[specLength]   = '\0';
+
+    int available = MESSAGE_SIZE - *pos;
+    int written   = 0;
+    switch (arg->type) {
+        case ARG_INT:     written = (spec->conversion == 'c')
+                                    ? snprintf(out + *pos, available, specBuffer, (int) arg->i)
+                                    : snprintf(out + *pos, available, specBuffer, arg->i);
+                          break;
+        case ARG_UINT:    written = snprintf(out + *pos, available, specBuffer, arg->u);          break;
+        case ARG_DOUBLE:  written = snprintf(out + *pos, available, specBuffer, arg->d);          break;
+        case ARG_STRING:  written = snprintf(out + *pos, available, specBuffer, 
+                                             entry->strings + arg->offset);                       break;
+        case ARG_POINTER: written = snprintf(out + *pos, available, specBuffer, arg->p);          break;
+    }
+    if (written > 0) {
+        *pos += (written < available) ? written : available - 1;
+    }
+}
+
+static void formatEntry(LogEntry* entry, char* out)
+{
+    int         pos = 0;
+    int         n   = 0;
+    const char* p   = entry->format;
+    while (*p && pos < MESSAGE_SIZE - 1) {
+        if (*p != '%') {
+            out[pos++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            out[pos++] = '%';
+            p += 2;
+            continue;
+        }
+        if (n >= entry->argCount) {
+            out[pos++] = *p++; // arguments were not captured, copy the rest literally
+            continue;
+        }
+        FormatSpec spec;
+        p = parseSpec(p + 1, &spec);
+        if (spec.conversion && strchr("diucoxXfFeEgGaAsp", spec.conversion)) {
+            appendArg(out, &pos, &spec, entry, &n);
+        }
+    }
+    if (*p && pos >= MESSAGE_SIZE - 1) {
+        strcpy(out + MESSAGE_SIZE - 4, "...");
+    } else {
+        out[pos] = '\0';
+    }
+}
+
+/* ============================================================================================ */
+
+static bool pushEntry(bool isError, const char* fmt, va_list args)
+{
+    LogQueue* q   = &logQueue;
+    int       pos = atomic_get(&q->enqueuePos);
+    LogEntry* entry;
+    while (true) {
+        entry = q->entries + (pos & (QUEUE_CAPACITY - 1));
+        int dif = atomic_get(&entry->sequence) - pos;
+        if (dif == 0) {
+            if (atomic_set_if_equal(&q->enqueuePos, pos, pos + 1)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return false; // full
+        }
+        pos = atomic_get(&q->enqueuePos);
+    }
+    entry->isError = isError;
+    size_t fmtLength = strlen(fmt);
+    if (fmtLength < (size_t) FORMAT_SPACE) {
+        memcpy(entry->format, fmt, fmtLength + 1);
+        captureArgs(entry, entry->format, args);
+    } else {
+        // too long: the truncated format string is delivered without arguments
+        strcpy(entry->format, "%s");
+        memcpy(entry->strings, fmt, STRING_SPACE - 1);
+        entry->strings[STRING_SPACE - 1] = '\0';
+        entry->args[0].type   = ARG_STRING;
+        entry->args[0].offset = 0;
+        entry->argCount       = 1;
+    }
+    atomic_set(&entry->sequence, pos + 1);
+    return true;
+}
+
+static bool popEntry(LogEntry* rslt)
+{
+    LogQueue* q   = &logQueue;
+    int       pos = atomic_get(&q->dequeuePos);
+    LogEntry* entry;
+    while (true) {
+        entry = q->entries + (pos & (QUEUE_CAPACITY - 1));
+        int dif = atomic_get(&entry->sequence) - (pos + 1);
+        if (dif == 0) {
+            if (atomic_set_if_equal(&q->dequeuePos, pos, pos + 1)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return false; // empty
+        }
+        pos = atomic_get(&q->dequeuePos);
+    }
+    rslt->isError  = entry->isError;
+    memcpy(rslt->format,  entry->format,  sizeof(entry->format));
+    rslt->argCount = entry->argCount;
+    memcpy(rslt->args,    entry->args,    sizeof(entry->args));
+    memcpy(rslt->strings, entry->strings, sizeof(entry->strings));
+    atomic_set(&entry->sequence, pos + QUEUE_CAPACITY);
+    return true;
+}
+
+/* ============================================================================================ */
+
+static void drainEntries()
+{
+    int dropped = atomic_get(&logQueue.dropped);
+    while (dropped > 0 && !atomic_set_if_equal(&logQueue.dropped, dropped, 0)) {
+        dropped = atomic_get(&logQueue.dropped);
+    }
+    if (dropped > 0) {
+        lrtaudio::log_info("lrtaudio: %d log messages from realtime threads were lost", dropped);
+    }
+    LogEntry entry;
+    char     msg[MESSAGE_SIZE];
+    while (popEntry(&entry)) {
+        formatEntry(&entry, msg);
+        if (entry.isError) {
+            lrtaudio::log_error("%s", msg);
+        } else {
+            lrtaudio::log_info("%s", msg);
+        }
+    }
+}
+
+static void drainMain(void* arg)
+{
+    LogDrain* drain = (LogDrain*) arg;
+
+    while (!atomic_get(&drain->shutdown)) {
+        async_sleep_millis(DRAIN_MILLIS);
+        drainEntries();
+    }
+    drainEntries();
+}
+
+/* ============================================================================================ */
+
+static void assureQueueInitialized()
+{
+    LogQueue* q = &logQueue;
+    if (atomic_get(&q->initStage) != 2) {
+        if (atomic_set_if_equal(&q->initStage, 0, 1)) {
+            for (int i = 0; i < QUEUE_CAPACITY; ++i) {
+                atomic_set(&q->entries[i].sequence, i);
+            }
+            atomic_set(&q->initStage, 2);
+        } else {
+            while (atomic_get(&q->initStage) != 2) {
+                async_sleep_millis(1);
+            }
+        }
+    }
+}
+
+/* ============================================================================================ */
+
+LogDrain* rtlog::new_drain()
+{
+    assureQueueInitialized();
+
+    LogDrain* drain = (LogDrain*) calloc(1, sizeof(LogDrain));
+    if (!drain) {
+        return NULL;
+    }
+    if (!async_thread_start(&drain->thread, drainMain, drain)) {
+        free(drain);
+        return NULL;
+    }
+    atomic_inc(&logQueue.drainCount);
+    return drain;
+}
+
+/* ============================================================================================ */
+
+void rtlog::free_drain(LogDrain* drain)
+{
+    atomic_dec(&logQueue.drainCount);
+    atomic_set(&drain->shutdown, 1);
+    async_thread_join(&drain->thread);
+    free(drain);
+}
+
+/* ============================================================================================ */
+
+bool rtlog::log_errorV(const char* fmt, va_list args)
+{
+    if (atomic_get(&logQueue.drainCount) > 0) {
+        if (!pushEntry(true, fmt, args)) {
+            atomic_inc(&logQueue.dropped);
+        }
+        return true;
+    }
+    return lrtaudio::log_errorV(fmt, args);
+}
+
+void rtlog::log_error(const char* fmt, ...)
+{
+    bool finished;
+    do {
+        va_list args;
+        va_start(args, fmt);
+            finished = rtlog::log_errorV(fmt, args);
+        va_end(args);
+    } while (!finished);
+}
+
+/* ============================================================================================ */
+
+bool rtlog::log_infoV(const char* fmt, va_list args)
+{
+    if (atomic_get(&logQueue.drainCount) > 0) {
+        if (!pushEntry(false, fmt, args)) {
+            atomic_inc(&logQueue.dropped);
+        }
+        return true;
+    }
+    return lrtaudio::log_infoV(fmt, args);
+}
+
+void rtlog::log_info(const char* fmt, ...)
+{
+    bool finished;
+    do {
+        va_list args;
+        va_start(args, fmt);
+            finished = rtlog::log_infoV(fmt, args);
+        va_end(args);
+    } while (!finished);
+}
+
+/* ============================================================================================ */
@@ -0,0 +1,45 @@
+#ifndef LRTAUDIO_RTLOG_HPP
+#define LRTAUDIO_RTLOG_HPP
+
+#include "util.h"
+
+/* ============================================================================================ */
+namespace lrtaudio {
+/* ============================================================================================ */
+
+struct LogDrain;
+
+/* ============================================================================================ */
+namespace rtlog {
+/* ============================================================================================ */
+
+/**
+ * Starts a thread that formats and delivers deferred log messages.
+ * Deferred logging is possible while at least one drain thread is
+ * running, i.e. while a stream is open. Returns NULL on error.
+ */
+LogDrain* new_drain();
+
+/**
+ * Delivers all remaining messages and stops the thread.
+ */
+void free_drain(LogDrain* drain);
+
+/**
+ * Realtime safe variants of lrtaudio::log_errorV and log_infoV: the format
+ * string and the arguments are copied into a preallocated lock-free queue,
+ * formatting and delivery are done by the drain thread. Format strings
+ * longer than 255 bytes are delivered truncated without their arguments.
+ * If no drain thread is running, the message is logged immediately.
+ */
+bool log_errorV(const char* fmt, va_list args);
+bool log_infoV(const char* fmt, va_list args);
+
+void log_error(const char* fmt, ...);
+void log_info(const char* fmt, ...);
+
+/* ============================================================================================ */
+} } // namespace lrtaudio::rtlog
+/* ============================================================================================ */
+
+#endif // LRTAUDIO_RTLOG_HPP
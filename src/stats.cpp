@@ -0,0 +1,243 @@
+#include "main.hpp"
+#include "controller.hpp"
+#include "stream.hpp"
+#include "stats.hpp"
+
+using namespace lrtaudio;
+
+/* ============================================================================================ */
+
+static const int MIN_OCTAVE = 10; // 1024 nanoseconds
+
+/* ============================================================================================ */
+
+static int bucketIndex(uint64_t nanos)
+{
+    if (nanos < ((uint64_t)1 << MIN_OCTAVE)) {
+        return 0;
+    }
+    int msb = MIN_OCTAVE;
+    while (msb < 63 && (nanos >> (msb + 1)) != 0) {
+        ++msb;
+    }
+    int sub   = (int)(nanos >> (msb - 2)) & 3;
+    int index = 1 + (msb - MIN_OCTAVE) * 4 + sub;
+    return index < LOAD_STATS_BUCKETS ? index : LOAD_STATS_BUCKETS - 1;
+}
+
+static uint64_t bucketUpperNanos(int index)
+{
+    if (index == 0) {
+        return (uint64_t)1 << MIN_OCTAVE;
+    }
+    int msb = MIN_OCTAVE + (index - 1) / 4;
+    int sub = (index - 1) % 4;
+    return (uint64_t)(5 + sub) << (msb - 2);
+}
+
+/* ============================================================================================ */
+
+void stats::add(LoadStats* stats, uint64_t nanos)
+{
+    atomic_inc(&stats->sequence); // odd: update in progress
+
+    if (atomic_get(&stats->resetRequested)) {
+        stats->count    = 0;
+        stats->sumNanos = 0;
+        stats->minNanos = 0;
+        stats->maxNanos = 0;
+        memset(stats->histogram, 0, sizeof(stats->histogram));
+        atomic_set(&stats->resetRequested, 0);
+    }
+    if (stats->count == 0 || nanos < stats->minNanos) {
+        stats->minNanos = nanos;
+    }
+    if (nanos > stats->maxNanos) {
+        stats->maxNanos = nanos;
+    }
+    stats->count    += 1;
+    stats->sumNanos += nanos;
+    stats->histogram[bucketIndex(nanos)] += 1;
+
+    atomic_inc(&stats->sequence); // even: update finished
+}
+
+/* ============================================================================================ */
+
+void stats::request_reset(LoadStats* stats)
+{
+    atomic_set(&stats->resetRequested, 1);
+}
+
+/* ============================================================================================ */
+
+static lua_Number percentileSeconds(LoadStats* s, lua_Number p)
+{
+    uint64_t limit = (uint64_t)(p * s->count);
+    uint64_t sum   = 0;
+    for (int i = 0; i < LOAD_STATS_BUCKETS; ++i) {
+        sum += s->histogram[i];
+        if (sum > limit || sum == s->count) {
+            uint64_t upper = bucketUpperNanos(i);
+            return (upper < s->maxNanos ? upper : s->maxNanos) * 1e-9;
+        }
+    }
+    return s->maxNanos * 1e-9;
+}
+
+/* ============================================================================================ */
+
+void stats::push_stats(lua_State* L, LoadStats* stats, lua_Number periodSeconds)
+{
+    LoadStats s;
+    while (true) {
+        int seq = atomic_get(&stats->sequence);
+        if ((seq & 1) == 0) {
+            memcpy(&s, stats, sizeof(LoadStats));
+            if (atomic_get(&stats->sequence) == seq) {
+                break;
+            }
+        }
+        async_cpu_relax();
+    }
+    if (atomic_get(&stats->resetRequested)) {
+        s.count = 0;
+    }
+    lua_Number mean = s.count > 0 ? (s.sumNanos * 1e-9) / s.count : 0;
+    lua_Number max  = s.count > 0 ? s.maxNanos * 1e-9 : 0;
+
+    lua_newtable(L);                                        /* -> stats */
+    lua_pushinteger(L, s.count);
+    lua_setfield(L, -2, "count");
+    lua_pushnumber(L, s.count > 0 ? s.minNanos * 1e-9 : 0);
+    lua_setfield(L, -2, "min");
+    lua_pushnumber(L, mean);
+    lua_setfield(L, -2, "mean");
+    lua_pushnumber(L, max);
+    lua_setfield(L, -2, "max");
+    lua_pushnumber(L, s.count > 0 ? percentileSeconds(&s, 0.50) : 0);
+    lua_setfield(L, -2, "p50");
+    lua_pushnumber(L, s.count > 0 ? percentileSeconds(&s, 0.90) : 0);
+    lua_setfield(L, -2, "p90");
+    lua_pushnumber(L, s.count > 0 ? percentileSeconds(&s, 0.99) : 0);
+    lua_setfield(L, -2, "p99");
+    if (periodSeconds > 0) {
+        lua_pushnumber(L, mean / periodSeconds);
+        lua_setfield(L, -2, "load");
+        lua_pushnumber(L, max / periodSeconds);
+        lua_setfield(L, -2, "maxLoad");
+    }
+}
+
+/* ============================================================================================ */
+
+void stats::push_stream_stats(lua_State* L, Stream* stream, bool reset)
+{
+    lua_Number period = stream->sampleRate > 0 ? (lua_Number)stream->bufferFrames / stream->sampleRate 
+                                               : 0;
+    lua_newtable(L);                                        /* -> rslt */
+    push_stats(L, &stream->cycleStats, period);             /* -> rslt, stats */
+    lua_setfield(L, -2, "cycle");                           /* -> rslt */
+    lua_pushinteger(L, atomic_get(&stream->degradedCycles));
+    lua_setfield(L, -2, "degradedCycles");
+    if (reset) {
+        request_reset(&stream->cycleStats);
+    }
+    lua_newtable(L);                                        /* -> rslt, list */
+    stream::ProcList* list = stream->procRegList;
+    for (int i = 0; list && i < list->count; ++i) {
+        stream::ProcReg* reg = list->regs[i];
+        push_stats(L, &reg->loadStats, period);             /* -> rslt, list, stats */
+        lua_pushstring(L, reg->processorName);              /* -> rslt, list, stats, name */
+        lua_setfield(L, -2, "name");                        /* -> rslt, list, stats */
+        lua_pushinteger(L, atomic_get(&reg->bypassCount));  /* -> rslt, list, stats, count */
+        lua_setfield(L, -2, "bypassed");                    /* -> rslt, list, stats */
+        lua_rawseti(L, -2, i + 1);                          /* -> rslt, list */
+        if (reset) {
+            request_reset(&reg->loadStats);
+        }
+    }
+    lua_setfield(L, -2, "processors");                      /* -> rslt */
+}
+
+/* ============================================================================================ */
+void stats::add_xrun(XrunStats* stats, bool inputOverflow, bool outputUnderflow, 
+                     uint32_t frameTime, double streamTime)
+{
+    atomic_inc(&stats->sequence); // odd: update in progress
+
+    if (atomic_get(&stats->resetRequested)) {
+        stats->count            = 0;
+        stats->inputOverflows   = 0;
+        stats->outputUnderflows = 0;
+        stats->eventCount       = 0;
+        atomic_set(&stats->resetRequested, 0);
+    }
+    stats->count += 1;
+    if (inputOverflow) {
+        stats->inputOverflows += 1;
+    }
+    if (outputUnderflow) {
+        stats->outputUnderflows += 1;
+    }
+    XrunEvent* e = stats->events + (stats->eventCount % XRUN_EVENTS);
+    e->frameTime       = frameTime;
+    e->streamTime      = streamTime;
+    e->inputOverflow   = inputOverflow;
+    e->outputUnderflow = outputUnderflow;
+    stats->eventCount += 1;
+
+    atomic_inc(&stats->sequence); // even: update finished
+}
+
+/* ============================================================================================ */
+
+void stats::push_xrun_stats(lua_State* L, XrunStats* stats, bool reset)
+{
+    XrunStats s;
+    while (true) {
+        int seq = atomic_get(&stats->sequence);
+        if ((seq & 1) == 0) {
+            memcpy(&s, stats, sizeof(XrunStats));
+            if (atomic_get(&stats->sequence) == seq) {
+                break;
+            }
+        }
+        async_cpu_relax();
+    }
+    if (atomic_get(&stats->resetRequested)) {
+        s.count            = 0;
+        s.inputOverflows   = 0;
+        s.outputUnderflows = 0;
+        s.eventCount       = 0;
+    }
+    if (reset) {
+        atomic_set(&stats->resetRequested, 1);
+    }
+    lua_newtable(L);                                        /* -> stats */
+    lua_pushinteger(L, s.count);
+    lua_setfield(L, -2, "count");
+    lua_pushinteger(L, s.inputOverflows);
+    lua_setfield(L, -2, "inputOverflows");
+    lua_pushinteger(L, s.outputUnderflows);
+    lua_setfield(L, -2, "outputUnderflows");
+    
+    lua_newtable(L);                                        /* -> stats, events */
+    uint64_t first = s.eventCount > XRUN_EVENTS ? s.eventCount - XRUN_EVENTS : 0;
+    for (uint64_t i = first; i < s.eventCount; ++i) {
+        XrunEvent* e = s.events + (i % XRUN_EVENTS);
+        lua_newtable(L);                                    /* -> stats, events, event */
+        lua_pushinteger(L, e->frameTime);
+        lua_setfield(L, -2, "frameTime");
+        lua_pushnumber(L, e->streamTime);
+        lua_setfield(L, -2, "streamTime");
+        lua_pushboolean(L, e->inputOverflow);
+        lua_setfield(L, -2, "inputOverflow");
+        lua_pushboolean(L, e->outputUnderflow);
+        lua_setfield(L, -2, "outputUnderflow");
+        lua_rawseti(L, -2, (int)(i - first + 1));           /* -> stats, events */
+    }
+    lua_setfield(L, -2, "events");                          /* -> stats */
+}
+
+/* ============================================================================================ */
@@ -0,0 +1,107 @@
+#ifndef LRTAUDIO_STATS_HPP
+#define LRTAUDIO_STATS_HPP
+
+#include "util.h"
+
+/* ============================================================================================ */
+namespace lrtaudio {
+/* ============================================================================================ */
+
+struct Stream;
+
+/**
+ * Histogram buckets: bucket 0 for durations below 1024 nanoseconds, then
+ * 4 buckets per octave, i.e. the percentiles have a resolution of 25%.
+ */
+static const int LOAD_STATS_OCTAVES = 24;
+static const int LOAD_STATS_BUCKETS = 1 + 4 * LOAD_STATS_OCTAVES;
+
+/**
+ * Processing time statistics. Updated only by the thread that is
+ * measuring, read by the Lua thread without locking: the sequence
+ * counter is odd while an update is in progress.
+ */
+struct LoadStats
+{
+    AtomicCounter sequence;
+    AtomicCounter resetRequested;
+    uint64_t      count;
+    uint64_t      sumNanos;
+    uint64_t      minNanos;
+    uint64_t      maxNanos;
+    uint32_t      histogram[LOAD_STATS_BUCKETS];
+};
+
+/**
+ * Number of most recent xruns that are kept in XrunStats::events.
+ */
+static const int XRUN_EVENTS = 16;
+
+struct XrunEvent
+{
+    uint32_t frameTime;       // Stream::processBeginFrameTime of the cycle
+    double   streamTime;      // stream time reported by RtAudio
+    bool     inputOverflow;
+    bool     outputUnderflow;
+};
+
+/**
+ * Xrun counters and ring of the most recent xruns. Updated only by
+ * the realtime thread, read like LoadStats.
+ */
+struct XrunStats
+{
+    AtomicCounter sequence;
+    AtomicCounter resetRequested;
+    uint64_t      count;
+    uint64_t      inputOverflows;
+    uint64_t      outputUnderflows;
+    uint64_t      eventCount;   // total number of events written into the ring
+    XrunEvent     events[XRUN_EVENTS];
+};
+
+/* ============================================================================================ */
+namespace stats {
+/* ============================================================================================ */
+
+/**
+ * Must only be called from the measuring thread.
+ */
+void add(LoadStats* stats, uint64_t nanos);
+
+/**
+ * Statistics are cleared with the next call of add().
+ */
+void request_reset(LoadStats* stats);
+
+/**
+ * Pushes a table with fields count, min, mean, max, p50, p90 and p99,
+ * durations in seconds. If periodSeconds > 0, the fields load and
+ * maxLoad are added, i.e. mean and max relative to the period.
+ */
+void push_stats(lua_State* L, LoadStats* stats, lua_Number periodSeconds);
+
+/**
+ * Pushes a table with field cycle containing the statistics of the 
+ * whole process cycle and field processors containing a list of 
+ * statistics for the registered processors in processing order.
+ */
+void push_stream_stats(lua_State* L, Stream* stream, bool reset);
+
+/**
+ * Must only be called from the realtime thread.
+ */
+void add_xrun(XrunStats* stats, bool inputOverflow, bool outputUnderflow, 
+              uint32_t frameTime, double streamTime);
+
+/**
+ * Pushes a table with fields count, inputOverflows, outputUnderflows 
+ * and events, a list of the most recent xruns, oldest first.
+ */
+void push_xrun_stats(lua_State* L, XrunStats* stats, bool reset);
+
+/* ============================================================================================ */
+} } // namespace lrtaudio::stats
+/* ============================================================================================ */
+
+#endif // LRTAUDIO_STATS_HPP
@@ -4,8 +4,17 @@
 #include "channel.hpp"
 #include "procbuf.hpp"
 #include "error.hpp"
-
-#include "receiver_capi.h"
+#include "workers.hpp"
+#include "convert.hpp"
+#include "kernels.hpp"
+#include "route.hpp"
+#include "recorder.hpp"
+#include "player.hpp"
+#include "midiport.hpp"
+#include "arena.hpp"
+#include "events.hpp"
+#include "rtlog.hpp"
+#include "vdevice.hpp"
 
 using namespace lrtaudio;
 
@@ -74,22 +83,270 @@ static void setStreamNameRef(lua_State* L, Stream* stream, const char* name)
 
 /* ============================================================================================ */
 
-static void addIntegerToWriter(Stream* stream, lua_Integer i)
+static float* getOutputBuffer(Stream* stream, stream::ConnectorInfo* info, uint32_t nframes)
+{
+    if (info->isChannel) {
+        return ((float*)stream->currentOutputBuffers) + (info->channelUdata->index-1) * nframes;
+    } else {
+        return (float*)info->procBufUdata->bufferData;
+    }
+}
+
+/* ============================================================================================ */
+
+static bool isDeadlineExceeded(Stream* stream, stream::ProcReg* reg)
 {
-    stream->statusReceiverCapi->addIntegerToWriter(stream->statusWriter, i);
+    return stream->cycleDeadline != 0 
+        && atomic_get(&reg->priority) <= 0
+        && reg->processCallback != route::process  // routes are cheap, bypassing would only cut signals
+        && async_monotonic_nanos() > stream->cycleDeadline;
+}
+
+/* ============================================================================================ */
+
+static bool isFailed(Stream* stream, stream::ProcReg* reg)
+{
+    if (atomic_get(&reg->failed)) {
+        return true;
+    }
+    // failCount is only reset by a successful call, a processor activated 
+    // again after ERROR_POLICY_DEACTIVATE must not wait for a retry window
+    return reg->failCount > 0 
+        && atomic_get(&reg->errorPolicy) == stream::ERROR_POLICY_RETRY
+        && (int32_t)(reg->retryFrameTime - stream->processBeginFrameTime) > 0;
 }
 
-static void addStringToWriter(Stream* stream, const char* str)
+/* ============================================================================================ */
+
+static const int MAX_BACKOFF_SHIFT = 10;
+
+/**
+ * Returns false if the stream has to be invalidated.
+ */
+static bool recoverProcessorError(Stream* stream, stream::ProcReg* reg, int rc)
 {
-    stream->statusReceiverCapi->addStringToWriter(stream->statusWriter, str, strlen(str));
+    int policy = atomic_get(&reg->errorPolicy);
+    if (policy == stream::ERROR_POLICY_STOP) {
+        return false;
+    }
+    if (policy == stream::ERROR_POLICY_DEACTIVATE) {
+        atomic_set(&reg->failed, 1);
+        reg->retryFrameTime = stream->processBeginFrameTime; // no retry window
+    } else {
+        int      shift = reg->failCount < MAX_BACKOFF_SHIFT ? reg->failCount : MAX_BACKOFF_SHIFT;
+        uint64_t delay = (uint64_t)atomic_get(&reg->retryFrames) << shift;
+        reg->retryFrameTime = stream->processBeginFrameTime + (uint32_t)(delay < 0x7fffffff ? delay : 0x7fffffff);
+    }
+    reg->failCount    += 1;
+    reg->lastErrorCode = rc;
+    atomic_set(&reg->errorPending, 1);
+    atomic_inc(&stream->recoveredErrorCount);
+    return true;
 }
 
-static void addMsgToReceiver(Stream* stream)
+/* ============================================================================================ */
+
+int stream::process_reg(Stream* stream, ProcReg* reg, bool activated, uint32_t nframes)
 {
-    int rc = stream->statusReceiverCapi->msgToReceiver(stream->statusReceiver, stream->statusWriter, 
-                                                       false, false, NULL, NULL);
-    if (rc != 0) {
-        fprintf(stderr, "lrtaudio: error calling status receiver.");
+    if (activated && isFailed(stream, reg)) {
+        activated = false;
+    }
+    if (activated && isDeadlineExceeded(stream, reg)) {
+        activated = false;
+        atomic_inc(&reg->bypassCount);
+        atomic_inc(&stream->bypassedCount);
+    }
+    if (activated) {
+        reg->outBuffersCleared = false;
+        bool     measure = atomic_get(&stream->measureLoad);
+        uint64_t begin   = measure ? async_monotonic_nanos() : 0;
+        int rc = reg->processCallback(nframes, reg->processorData);
+        if (measure) {
+            stats::add(&reg->loadStats, async_monotonic_nanos() - begin);
+        }
+        if (rc == 0) {
+            reg->failCount = 0;
+            if (reg->hasWriterSlots) {
+                for (int i = 0, n = reg->connectorCount; i < n; ++i) {
+                    ConnectorInfo* info = reg->connectorInfos + i;
+                    if (info->slotBuffer) {
+                        kernels::add(getOutputBuffer(stream, info, nframes), info->slotBuffer, nframes);
+                    }
+                }
+            }
+            return 0;
+        }
+        if (!recoverProcessorError(stream, reg, rc)) {
+            return rc;
+        }
+        // failed processor is treated like an inactive one
+    } 
+    if (!reg->outBuffersCleared) {
+        for (int i = 0, n = reg->connectorCount; i < n; ++i) {
+            ConnectorInfo* info = reg->connectorInfos + i;
+            if (info->slotMidi) {
+                procbuf::clear_midi_events(info->slotMidi);
+            }
+            else if (info->isOutput && !info->slotBuffer) {
+                if (info->isChannel) {
+                    float* b = ((float*)stream->currentOutputBuffers) + (info->channelUdata->index-1) * nframes;
+                    kernels::clear(b, nframes);
+                } else if (info->isProcBuf) {
+                    if (info->procBufUdata->isAudio) {
+                        float* b = (float*)info->procBufUdata->bufferData;
+                        kernels::clear(b, nframes);
+                    }
+                    else if (info->procBufUdata->isMidi) {
+                        procbuf::clear_midi_events(info->procBufUdata);
+                    }
+                }
+            }
+        }
+        reg->outBuffersCleared = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+int stream::set_processor_priority(Stream* stream, const char* processorName, int priority)
+{
+    int count = 0;
+    ProcList* list = stream->procRegList;
+    for (int i = 0; list && i < list->count; ++i) {
+        ProcReg* reg = list->regs[i];
+        if (strcmp(reg->processorName, processorName) == 0) {
+            atomic_set(&reg->priority, priority);
+            ++count;
+        }
+    }
+    return count;
+}
+
+/* ============================================================================================ */
+
+int stream::set_processor_error_policy(Stream* stream, const char* processorName, 
+                                       ErrorPolicy policy, uint32_t retryFrames)
+{
+    int count = 0;
+    ProcList* list = stream->procRegList;
+    for (int i = 0; list && i < list->count; ++i) {
+        ProcReg* reg = list->regs[i];
+        if (strcmp(reg->processorName, processorName) == 0) {
+            atomic_set(&reg->retryFrames, retryFrames);
+            atomic_set(&reg->errorPolicy, policy);
+            ++count;
+        }
+    }
+    return count;
+}
+
+/* ============================================================================================ */
+
+void stream::clear_sum_targets(Stream* stream, ProcList* list, uint32_t nframes)
+{
+    for (int i = 0; i < list->sumTargetCount; ++i) {
+        kernels::clear(getOutputBuffer(stream, list->sumTargets[i], nframes), nframes);
+    }
+}
+
+/* ============================================================================================ */
+
+void stream::apply_aliases(ProcList* list)
+{
+    for (int i = 0; i < list->aliasCount; ++i) {
+        Alias* a = list->aliases + i;
+        if (atomic_get_ptr(&a->target->aliasSource) != a->source) {
+            atomic_set_ptr(&a->target->aliasSource, a->source);
+        }
+    }
+}
+
+/* ============================================================================================ */
+
+static void convertInputs(Stream* stream, stream::ProcList* list, void* inputBuffer, uint32_t nframes)
+{
+    int    channelCount = stream->inputs.max - stream->inputs.min + 1;
+    size_t sampleSize   = convert::sample_size(stream->sampleFormat);
+    int    stride       = stream->interleaved ? channelCount : 1;
+    
+    for (int i = 0; i < list->inputChannelCount; ++i) {
+        int   index = list->channelIndexes[i];
+        int   pos   = index - stream->inputs.min;
+        char* src   = (char*)inputBuffer + pos * sampleSize * (stream->interleaved ? 1 : nframes);
+        convert::to_float(stream->inputChannelBuffers + (index-1) * nframes, src, 
+                          stream->sampleFormat, stride, nframes);
+    }
+}
+
+/* ============================================================================================ */
+
+static void convertOutputs(Stream* stream, stream::ProcList* list, void* outputBuffer, uint32_t nframes)
+{
+    int    channelCount = stream->outputs.max - stream->outputs.min + 1;
+    size_t sampleSize   = convert::sample_size(stream->sampleFormat);
+    int    stride       = stream->interleaved ? channelCount : 1;
+
+    memset(outputBuffer, 0, channelCount * nframes * sampleSize);
+
+    if (list) {
+        for (int i = list->inputChannelCount, n = i + list->outputChannelCount; i < n; ++i) {
+            int   index = list->channelIndexes[i];
+            int   pos   = index - stream->outputs.min;
+            char* dst   = (char*)outputBuffer + pos * sampleSize * (stream->interleaved ? 1 : nframes);
+            convert::from_float(dst, stream->outputChannelBuffers + (index-1) * nframes, 
+                                stream->sampleFormat, stride, nframes);
+        }
+    }
+}
+
+/* ============================================================================================ */
+
+static void reportXrun(Stream* stream, RtAudioStreamStatus status, double streamTime)
+{
+    bool inputOverflow   = (status & RTAUDIO_INPUT_OVERFLOW)   != 0;
+    bool outputUnderflow = (status & RTAUDIO_OUTPUT_UNDERFLOW) != 0;
+
+    stats::add_xrun(&stream->xrunStats, inputOverflow, outputUnderflow, 
+                    stream->processBeginFrameTime, streamTime);
+
+    if (stream->statusEvents) {
+        events::push_event(stream->statusEvents, EVENT_XRUN, stream->processBeginFrameTime, streamTime,
+                           (int)status, NULL);
+    }
+}
+
+/* ============================================================================================ */
+
+static void reportDegradation(Stream* stream, int bypassed)
+{
+    atomic_inc(&stream->degradedCycles);
+
+    if (stream->statusEvents) {
+        events::push_event(stream->statusEvents, EVENT_DEGRADED, stream->processBeginFrameTime, 0,
+                           bypassed, NULL);
+    }
+}
+
+/* ============================================================================================ */
+
+static void reportProcessorErrors(Stream* stream, stream::ProcList* list)
+{
+    for (int i = 0; i < list->count; ++i) {
+        stream::ProcReg* reg = list->regs[i];
+        if (atomic_get(&reg->errorPending)) {
+            atomic_set(&reg->errorPending, 0);
+            bool deactivated = atomic_get(&reg->failed);
+            rtlog::log_error("lrtaudio: processor '%s' returned processing error %d, %s.", 
+                                reg->processorName, reg->lastErrorCode,
+                                deactivated ? "processor deactivated" : "retrying later");
+            if (stream->statusEvents) {
+                events::push_event(stream->statusEvents, 
+                                   deactivated ? EVENT_PROCESSOR_DEACTIVATED : EVENT_PROCESSOR_RETRY,
+                                   stream->processBeginFrameTime, 0, 
+                                   reg->lastErrorCode, reg->processorName);
+            }
+        }
     }
 }
 
@@ -99,77 +356,101 @@ int stream::rtaudio_callback(void* outputBuffer, void* inputBuffer,
                              unsigned int nframes, double streamTime, 
                              RtAudioStreamStatus status, void* voidData)
 {
-    Stream* stream = (Stream*) voidData;
+    Stream*  stream     = (Stream*) voidData;
+    bool     measure    = atomic_get(&stream->measureLoad);
+    int      budget     = atomic_get(&stream->cycleBudgetMicros);
+    uint64_t cycleBegin = async_monotonic_nanos();
+
+    stream->cycleDeadline = budget > 0 ? cycleBegin + (uint64_t)budget * 1000 : 0;
+    atomic_set(&stream->bypassedCount, 0);
+    atomic_set(&stream->recoveredErrorCount, 0);
+    stream->processBeginNanos = cycleBegin;
     
-    ProcReg** list = stream->activeProcRegList;
+    atomic_inc(&stream->processEpoch); // odd: list is in use
 
-    if (stream->confirmedProcRegList != list)
-    {
-        if (async_mutex_trylock(&stream->processMutex)) {
-            stream->confirmedProcRegList = list;
-            async_mutex_notify(&stream->processMutex);
-            async_mutex_unlock(&stream->processMutex);
-        }
+    ProcList* list = (ProcList*) atomic_get_ptr(&stream->activeProcRegList);
+    int       rc   = 0;
+
+    stream->processList = list;
+    procbuf::apply_midi_resize(stream);
+
+    if (status & (RTAUDIO_INPUT_OVERFLOW|RTAUDIO_OUTPUT_UNDERFLOW)) {
+        reportXrun(stream, status, streamTime);
     }
-    if (!stream->shutdownReceived)
+
+    if (!atomic_get(&stream->shutdownReceived))
     {
         if (list) {
-            stream->currentOutputBuffers = outputBuffer;
-            stream->currentInputBuffers  = inputBuffer;
-            int i = 0;
-            while (true) 
-            {
-                ProcReg* reg = list[i];
-                if (!reg) {
-                    break;
+            if (stream->convertSamples) {
+                if (inputBuffer) {
+                    convertInputs(stream, list, inputBuffer, nframes);
                 }
-                ProcessCallback* processCallback = reg->processCallback;
-                if (reg->activated) {
-                    reg->outBuffersCleared = false;
-                    int rc = processCallback(nframes, reg->processorData);
-                    if (rc != 0) {
-                        async_mutex_lock(&stream->processMutex);
-                        {
-                            lrtaudio::log_error("lrtaudio: stream invalidated because processor '%s' returned processing error %d.", reg->processorName, rc);
-                            stream->severeProcessingError = true;
-                            stream->shutdownReceived = true;
-                            async_mutex_notify(&stream->processMutex);
-
-                            if (stream->statusWriter) {
-                                addStringToWriter (stream, "ProcessingError");
-                                addStringToWriter (stream, "stream invalidated because processor returned processing error");
-                                addStringToWriter (stream, reg->processorName);
-                                addIntegerToWriter(stream, rc);
-                                addMsgToReceiver  (stream);
-                            }
-                        }
-                        async_mutex_unlock(&stream->processMutex);
-                        return rc;
+                stream->currentOutputBuffers = stream->outputChannelBuffers;
+                stream->currentInputBuffers  = stream->inputChannelBuffers;
+            } else {
+                stream->currentOutputBuffers = outputBuffer;
+                stream->currentInputBuffers  = inputBuffer;
+            }
+
+            ProcReg* errorReg = NULL;
+
+            apply_aliases(list);
+            clear_sum_targets(stream, list, nframes);
+            
+            if (stream->workerPool && list->maxParallel > 1) {
+                workers::process_parallel(stream->workerPool, list, nframes);
+                errorReg = (ProcReg*) atomic_get_ptr(&stream->errorProcReg);
+                if (errorReg) {
+                    rc = atomic_get(&stream->errorReturnCode);
+                }
+            } else {
+                int i = 0;
+                while (true) 
+                {
+                    ProcReg* reg = list->regs[i];
+                    if (!reg) {
+                        break;
                     }
-                } else if (!reg->outBuffersCleared) {
-                    for (int i = 0, n = reg->connectorCount; i < n; ++i) {
-                        ConnectorInfo* info = reg->connectorInfos + i;
-                        if (info->isOutput) {
-                            if (info->isChannel) {
-                                float* b = ((float*)outputBuffer) + (info->channelUdata->index-1) * nframes;
-                                memset(b, 0, nframes * sizeof(float));
-                            } else if (info->isProcBuf) {
-                                if (info->procBufUdata->isAudio) {
-                                    float* b = (float*)info->procBufUdata->bufferData;
-                                    memset(b, 0, nframes * sizeof(float));
-                                }
-                                
-                            }
-                        }
+                    rc = process_reg(stream, reg, list->activated[i], nframes);
+                    if (rc != 0) {
+                        errorReg = reg;
+                        break;
                     }
-                    reg->outBuffersCleared = true;
+                    ++i;
+                }
+            }
+            if (atomic_get(&stream->recoveredErrorCount) > 0) {
+                reportProcessorErrors(stream, list);
+            }
+            int bypassed = atomic_get(&stream->bypassedCount);
+            if (bypassed > 0) {
+                reportDegradation(stream, bypassed);
+            }
+            if (errorReg) {
+                rtlog::log_error("lrtaudio: stream invalidated because processor '%s' returned processing error %d.", errorReg->processorName, rc);
+                atomic_set(&stream->severeProcessingError, 1);
+                atomic_set(&stream->shutdownReceived, 1);
+
+                if (stream->statusEvents) {
+                    events::push_event(stream->statusEvents, EVENT_PROCESSING_ERROR, 
+                                       stream->processBeginFrameTime, 0, 
+                                       rc, errorReg->processorName);
                 }
-                ++i;
             }
         }
     }
-    stream->processBeginFrameTime += nframes;
-    return 0;
+    if (stream->convertSamples && outputBuffer) {
+        convertOutputs(stream, rc == 0 ? list : NULL, outputBuffer, nframes);
+    }
+    if (rc == 0) {
+        stream->processBeginFrameTime += nframes;
+    }
+    if (measure) {
+        stats::add(&stream->cycleStats, async_monotonic_nanos() - cycleBegin);
+    }
+    stream->processList = NULL;
+    atomic_inc(&stream->processEpoch); // even: list is not used until next cycle
+    return rc;
 }
 
 /* ============================================================================================ */
@@ -190,11 +471,32 @@ static void errorCallback(RtAudioError::Type type, const std::string& errorText)
 
 /* ============================================================================================ */
 
-int stream::open_stream(lua_State* L, ControllerUserData* udata, 
-                        uint32_t sampleRate, uint32_t bufferFrames,
-                        RtAudio::StreamOptions*    options,
-                        RtAudio::StreamParameters* outParams,
-                        RtAudio::StreamParameters* inpParams)
+/**
+ * Stops the threads that were started by newStream. Invoked on close or if
+ * opening the stream failed.
+ */
+static void freeStreamThreads(Stream* stream)
+{
+    if (stream->workerPool) {
+        workers::free_worker_pool(stream->workerPool);
+        stream->workerPool = NULL;
+    }
+    if (stream->statusEvents) {
+        events::free_event_ring(stream->statusEvents); // forwards remaining events
+        stream->statusEvents = NULL;
+    }
+    if (stream->logDrain) {
+        rtlog::free_drain(stream->logDrain); // delivers remaining messages
+        stream->logDrain = NULL;
+    }
+}
+
+/* ============================================================================================ */
+
+/**
+ * Creates udata->stream with the threads that are used by the process cycle.
+ */
+static Stream* newStream(lua_State* L, ControllerUserData* udata, int workerThreads, int realtimePriority)
 {
     if (udata->stream) {
         stream::release_stream(L, udata);
@@ -208,27 +510,60 @@ int stream::open_stream(lua_State* L, ControllerUserData* udata,
         stream->outputs.tableRef = LUA_REFNIL;
         stream->outputs.max      = -1;
         stream->streamNameRef    = LUA_REFNIL;
-        async_mutex_init(&stream->processMutex);
 
+        stream->logDrain = rtlog::new_drain();
+        if (!stream->logDrain) {
+            luaL_error(L, "error starting log thread");
+        }
         if (udata->statusReceiver) {
-            stream->statusReceiverCapi = udata->statusReceiverCapi;
-            stream->statusReceiver     = udata->statusReceiver;
-            stream->statusWriter       = udata->statusReceiverCapi->newWriter(1024, 2);
-            if (!stream->statusWriter) {
-                return luaL_error(L, "error creating writer for status receiver");
-            }
-        }
-        LRTAUDIO_CHECK(
-            udata->api,
-            udata->api->openStream(outParams, inpParams, RTAUDIO_FLOAT32, sampleRate, &bufferFrames,
-                                   stream::rtaudio_callback, stream, options
-            #if !LRTAUDIO_NEW_RTAUDIO
-                                   , errorCallback
-            #endif
+            stream->statusEvents = events::new_event_ring(udata->statusReceiverCapi, udata->statusReceiver);
+            if (!stream->statusEvents) {
+                freeStreamThreads(stream);
+                luaL_error(L, "error creating writer for status receiver");
+            }
+        }
+        if (workerThreads > 0) {
+            stream->workerPool = workers::new_worker_pool(stream, workerThreads, realtimePriority);
+            if (!stream->workerPool) {
+                freeStreamThreads(stream);
+                luaL_error(L, "error starting worker threads");
+            }
+        }
+    }
+    return udata->stream;
+}
+
+/* ============================================================================================ */
+
+int stream::open_stream(lua_State* L, ControllerUserData* udata, 
+                        uint32_t sampleRate, uint32_t bufferFrames,
+                        RtAudioFormat sampleFormat, int workerThreads, bool hugePages,
+                        RtAudio::StreamOptions*    options,
+                        RtAudio::StreamParameters* outParams,
+                        RtAudio::StreamParameters* inpParams)
+{
+    int realtimePriority = (options->flags & RTAUDIO_SCHEDULE_REALTIME) ? options->priority : -1;
+    
+    if (newStream(L, udata, workerThreads, realtimePriority)) {
+        Stream* stream = udata->stream;
+        try {
+            LRTAUDIO_CHECK(
+                udata->api,
+                udata->api->openStream(outParams, inpParams, sampleFormat, sampleRate, &bufferFrames,
+                                       stream::rtaudio_callback, stream, options
+                #if !LRTAUDIO_NEW_RTAUDIO
+                                       , errorCallback
+                #endif
+                )
             )
-        )
+        }
+        catch (...) {
+            freeStreamThreads(stream);
+            throw;
+        }
         if (bufferFrames == 0) {
             udata->api->closeStream();
+            freeStreamThreads(stream);
             return luaL_error(L, "error: zero bufferFrames");
         }
         stream->isOpen = true;
@@ -246,6 +581,37 @@ int stream::open_stream(lua_State* L, ControllerUserData* udata,
         stream->bufferFrames = bufferFrames;
         stream->numberOfBuffers = options->numberOfBuffers;
 
+        stream->sampleFormat   = sampleFormat;
+        stream->interleaved    = !(options->flags & RTAUDIO_NONINTERLEAVED);
+        stream->convertSamples = (sampleFormat != RTAUDIO_FLOAT32 || stream->interleaved);
+        stream->arena          = arena::new_arena(hugePages);
+        if (!stream->arena) {
+            udata->api->closeStream();
+            stream->isOpen = false;
+            freeStreamThreads(stream);
+            return luaL_error(L, "out of memory");
+        }
+        if (stream->convertSamples) {
+            if (inpParams) {
+                stream->inputChannelBuffers  = (float*) arena::alloc_buffer(stream->arena, 
+                                                                            stream->inputs.max * bufferFrames * sizeof(float));
+            }
+            if (outParams) {
+                stream->outputChannelBuffers = (float*) arena::alloc_buffer(stream->arena, 
+                                                                            stream->outputs.max * bufferFrames * sizeof(float));
+            }
+            if (   (inpParams && !stream->inputChannelBuffers)
+                || (outParams && !stream->outputChannelBuffers))
+            {
+                udata->api->closeStream();
+                stream->isOpen = false;
+                arena::free_arena(stream->arena);
+                stream->arena = NULL;
+                freeStreamThreads(stream);
+                return luaL_error(L, "out of memory");
+            }
+        }
+
         setStreamNameRef(L, stream, NULL);
      
         if (options->streamName.length() > 0) {
@@ -259,21 +625,132 @@ int stream::open_stream(lua_State* L, ControllerUserData* udata,
 
 /* ============================================================================================ */
 
+int stream::open_offline_stream(lua_State* L, ControllerUserData* udata, 
+                                uint32_t sampleRate, uint32_t bufferFrames,
+                                int inputChannels, int outputChannels,
+                                int workerThreads, bool hugePages)
+{
+    if (newStream(L, udata, workerThreads, -1)) {
+        Stream* stream = udata->stream;
+
+        stream->isOffline       = true;
+        stream->sampleRate      = sampleRate;
+        stream->bufferFrames    = bufferFrames;
+        stream->sampleFormat    = RTAUDIO_FLOAT32;
+        stream->interleaved     = false;
+        stream->convertSamples  = false;
+        stream->arena           = arena::new_arena(hugePages);
+        if (!stream->arena) {
+            freeStreamThreads(stream);
+            return luaL_error(L, "out of memory");
+        }
+        // the channel buffers are used directly as device buffers
+        if (inputChannels > 0) {
+            stream->inputChannelBuffers  = (float*) arena::alloc_buffer(stream->arena, 
+                                                                        inputChannels * bufferFrames * sizeof(float));
+        }
+        if (outputChannels > 0) {
+            stream->outputChannelBuffers = (float*) arena::alloc_buffer(stream->arena, 
+                                                                        outputChannels * bufferFrames * sizeof(float));
+        }
+        if (   (inputChannels  > 0 && !stream->inputChannelBuffers)
+            || (outputChannels > 0 && !stream->outputChannelBuffers))
+        {
+            arena::free_arena(stream->arena);
+            stream->arena = NULL;
+            freeStreamThreads(stream);
+            return luaL_error(L, "out of memory");
+        }
+        stream->isOpen = true;
+
+        RtAudio::StreamParameters params;
+        params.deviceId     = 0;
+        params.firstChannel = 0;
+        if (inputChannels > 0) {
+            params.nChannels = inputChannels;
+            setupChannelList(L, udata, &params, &stream->inputs);
+        }
+        if (outputChannels > 0) {
+            params.nChannels = outputChannels;
+            setupChannelList(L, udata, &params, &stream->outputs);
+        }
+        setStreamNameRef(L, stream, NULL);
+
+        udata->isStreamOpen = true;
+    }
+    return 0;
+}
+
+/* ============================================================================================ */
+
+uint32_t stream::render_offline(Stream* stream, uint32_t nframes)
+{
+    uint32_t rendered = 0;
+    while (rendered < nframes && !atomic_get(&stream->shutdownReceived)) {
+        double streamTime = (double)stream->processBeginFrameTime / stream->sampleRate;
+        int rc = rtaudio_callback(stream->outputChannelBuffers, stream->inputChannelBuffers,
+                                  stream->bufferFrames, streamTime, 0, stream);
+        if (rc != 0) {
+            break;
+        }
+        rendered += stream->bufferFrames;
+    }
+    return rendered;
+}
+
+/* ============================================================================================ */
+
 void stream::close_stream(ControllerUserData* udata)
 {
     if (udata->stream && udata->stream->isOpen) 
     {
         Stream* stream = udata->stream;
-        if (stream->isRunning) {
-            async_mutex_lock  (&stream->processMutex);
-                activate_proc_list_LOCKED(stream, NULL);
-            async_mutex_unlock(&stream->processMutex);
+        ProcList* activeList = (ProcList*) atomic_set_ptr(&stream->activeProcRegList, NULL);
+        if (activeList && activeList != stream->procRegList) {
+            // retired, freed below after the realtime thread has stopped
+            activeList->retiredEpoch = atomic_get(&stream->processEpoch);
+            activeList->nextRetired  = stream->retiredProcRegLists;
+            stream->retiredProcRegLists = activeList;
+        }
+
+        if (stream->virtualDevice) {
+            vdevice::free_virtual_device(stream->virtualDevice);
+            stream->virtualDevice = NULL;
+        }
+        if (!stream->isOffline) {
+            udata->api->closeStream();
         }
-        udata->api->closeStream();
         
+        if (stream->workerPool) {
+            workers::free_worker_pool(stream->workerPool);
+            stream->workerPool = NULL;
+        }
         udata->isStreamOpen = false;
-        stream->isOpen      = false;
-        stream->isRunning   = false;
+        stream->isOpen        = false;
+        stream->isRunning     = false;
+        stream->inTransaction = false;
+
+        reclaim_proc_lists(stream, true);
+        route::free_routes(stream);
+        recorder::free_recorders(stream); // completes the files
+        player::free_players(stream);
+        midiport::free_midi_ports(stream);
+
+        stream->inputChannelBuffers  = NULL;
+        stream->outputChannelBuffers = NULL;
+        if (stream->procRegList) {
+            for (int i = 0; i < stream->procRegList->count; ++i) {
+                ProcReg* reg = stream->procRegList->regs[i];
+                for (int j = 0; j < reg->connectorCount; ++j) {
+                    reg->connectorInfos[j].slotBuffer = NULL;
+                    if (reg->connectorInfos[j].slotMidi) {
+                        reg->connectorInfos[j].slotMidi->bufferData = NULL;
+                    }
+                }
+            }
+            free_proc_list(stream->procRegList);
+            stream->procRegList = NULL;
+        }
         {
             ChannelUserData* c = stream->firstChannelUserData;
             while (c) {
@@ -285,16 +762,19 @@ void stream::close_stream(ControllerUserData* udata)
         {
             ProcBufUserData* p = stream->firstProcBufUserData;
             while (p) {
-                p->ctrlUdata = NULL;
+                p->ctrlUdata    = NULL;
+                p->bufferData   = NULL;
+                p->bufferLength = 0;
                 p = p->nextProcBufUserData;
             }
         }
-        if (stream->statusWriter) {
-            stream->statusReceiverCapi->freeWriter(stream->statusWriter);
-            stream->statusWriter       = NULL;
+        if (stream->arena) {
+            arena::free_arena(stream->arena); // all buffers of the stream
+            stream->arena = NULL;
         }
-        stream->statusReceiverCapi = NULL;
-        stream->statusReceiver     = NULL;
+    }
+    if (udata->stream) {
+        freeStreamThreads(udata->stream); // also if opening the stream failed
     }
 }
 
@@ -343,21 +823,594 @@ void stream::check_not_closed(lua_State* L, ControllerUserData* udata)
 
 /* ============================================================================================ */
 
-void stream::activate_proc_list_LOCKED(Stream*    stream, 
-                                       ProcReg**  newList)
+void stream::update_proc_list(Stream*   stream, 
+                              ProcList* newList)
+{
+    ProcList* oldList = stream->procRegList;
+
+    stream->procRegList = newList;
+
+    if (oldList && oldList != atomic_get_ptr(&stream->activeProcRegList)) {
+        free_proc_list(oldList); // was never seen by realtime thread
+    }
+    if (!stream->inTransaction) {
+        publish_proc_list(stream, newList);
+    }
+}
+
+/* ============================================================================================ */
+
+void stream::publish_proc_list(Stream*   stream, 
+                               ProcList* newList)
+{
+    ProcList* oldList = (ProcList*) atomic_set_ptr(&stream->activeProcRegList, newList);
+
+    if (oldList && oldList != newList) {
+        // read epoch after publishing: a cycle starting later sees newList
+        oldList->retiredEpoch = atomic_get(&stream->processEpoch);
+        oldList->nextRetired  = stream->retiredProcRegLists;
+        stream->retiredProcRegLists = oldList;
+    }
+    reclaim_proc_lists(stream, false);
+}
+
+/* ============================================================================================ */
+
+bool stream::is_published(Stream* stream, ProcReg* reg)
+{
+    ProcList* list = (ProcList*) atomic_get_ptr(&stream->activeProcRegList);
+    if (list) {
+        for (int i = 0; i < list->count; ++i) {
+            if (list->regs[i] == reg) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* ============================================================================================ */
+
+static bool isReclaimable(Stream* stream, stream::ProcList* list)
+{
+    int epoch = list->retiredEpoch;
+    return   !stream->isRunning
+           || (epoch & 1) == 0
+           || atomic_get(&stream->processEpoch) != epoch;
+}
+
+/* ============================================================================================ */
+
+void stream::reclaim_proc_lists(Stream* stream, bool waitForRealtime)
+{
+    ProcList** ptr = &stream->retiredProcRegLists;
+    while (*ptr) {
+        ProcList* list = *ptr;
+        if (isReclaimable(stream, list)) {
+            *ptr = list->nextRetired;
+            free_proc_list(list);
+        } 
+        else if (waitForRealtime) {
+            async_sleep_millis(1); // at most until end of current process cycle
+        } 
+        else {
+            ptr = &list->nextRetired;
+        }
+    }
+}
+
+/* ============================================================================================ */
+
+
+
+static bool isSameConnector(stream::ConnectorInfo* a, stream::ConnectorInfo* b)
+{
+    if (a->isChannel && b->isChannel) {
+        return a->channelUdata == b->channelUdata;
+    }
+    if (a->isProcBuf && b->isProcBuf) {
+        return a->procBufUdata == b->procBufUdata;
+    }
+    return false;
+}
+
+/**
+ * true if reader has an input connector that is written by writer or if
+ * both are writing to the same output and writer was registered before, 
+ * i.e. writers of the same output are invoked in registration order.
+ * Writers of a MIDI stream buffer are independent, because additional 
+ * writers have their own buffers that are merged when the buffer is read.
+ */
+static bool dependsOn(stream::ProcReg* reader, stream::ProcReg* writer)
+{
+    if (reader == writer) {
+        return false;
+    }
+    bool isLaterWriter = (reader->registrationNumber > writer->registrationNumber);
+    for (int i = 0; i < reader->connectorCount; ++i) {
+        stream::ConnectorInfo* r = reader->connectorInfos + i;
+        bool isMidiWriter = r->isOutput && r->isProcBuf && r->procBufUdata->isMidi;
+        if (r->isInput || (isLaterWriter && !isMidiWriter)) {
+            for (int j = 0; j < writer->connectorCount; ++j) {
+                stream::ConnectorInfo* w = writer->connectorInfos + j;
+                if (w->isOutput && isSameConnector(r, w)) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * Sorts the list so that each processor comes after all processors that are
+ * writing to one of its input connectors. Processors without dependencies between
+ * each other keep their registration order. Dependency cycles are broken
+ * in registration order, i.e. the affected reader gets the data of the
+ * previous process cycle.
+ */
+static bool scheduleProcList(stream::ProcReg** list, int count)
+{
+    if (count <= 1) {
+        return true;
+    }
+    int*               predCounts = (int*)               calloc(count, sizeof(int));
+    stream::ProcReg**  sorted     = (stream::ProcReg**)  calloc(count, sizeof(stream::ProcReg*));
+    if (!predCounts || !sorted) {
+        if (predCounts) free(predCounts);
+        if (sorted)     free(sorted);
+        return false;
+    }
+    for (int j = 0; j < count; ++j) {
+        for (int i = 0; i < count; ++i) {
+            if (dependsOn(list[j], list[i])) {
+                predCounts[j] += 1;
+            }
+        }
+    }
+    for (int n = 0; n < count; ++n)
+    {
+        int next = -1;
+        for (int j = 0; j < count; ++j) {
+            if (   list[j] && predCounts[j] == 0
+                && (next < 0 || list[j]->registrationNumber < list[next]->registrationNumber))
+            {
+                next = j;
+            }
+        }
+        if (next < 0) {
+            // dependency cycle: take the earliest registered processor
+            for (int j = 0; j < count; ++j) {
+                if (   list[j]
+                    && (next < 0 || list[j]->registrationNumber < list[next]->registrationNumber))
+                {
+                    next = j;
+                }
+            }
+        }
+        stream::ProcReg* reg = list[next];
+        sorted[n]  = reg;
+        list[next] = NULL;
+        for (int j = 0; j < count; ++j) {
+            if (list[j] && dependsOn(list[j], reg)) {
+                predCounts[j] -= 1;
+            }
+        }
+    }
+    memcpy(list, sorted, sizeof(stream::ProcReg*) * count);
+    free(predCounts);
+    free(sorted);
+    return true;
+}
+
+/* ============================================================================================ */
+
+static bool containsChannel(int* indexes, int count, int index)
+{
+    for (int i = 0; i < count; ++i) {
+        if (indexes[i] == index) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool collectSumTargets(stream::ProcList* list)
+{
+    int connectorCount = 0;
+    for (int i = 0; i < list->count; ++i) {
+        connectorCount += list->regs[i]->connectorCount;
+    }
+    list->sumTargets = (stream::ConnectorInfo**) calloc(connectorCount + 1, sizeof(stream::ConnectorInfo*));
+    if (!list->sumTargets) {
+        return false;
+    }
+    for (int i = 0; i < list->count; ++i) {
+        stream::ProcReg* reg = list->regs[i];
+        for (int j = 0; j < reg->connectorCount; ++j) {
+            stream::ConnectorInfo* info = reg->connectorInfos + j;
+            if (info->slotBuffer) {
+                bool found = false;
+                for (int k = 0; k < list->sumTargetCount && !found; ++k) {
+                    found = isSameConnector(list->sumTargets[k], info);
+                }
+                if (!found) {
+                    list->sumTargets[list->sumTargetCount++] = info;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/* ============================================================================================ */
+
+/**
+ * true if the buffer of source is, possibly via other aliases of the list,
+ * the buffer of target.
+ */
+static bool isAliasOf(stream::ProcList* list, stream::ConnectorInfo* source, ProcBufUserData* target)
+{
+    for (int n = 0; source && source->isProcBuf && n <= list->aliasCount; ++n) {
+        if (source->procBufUdata == target) {
+            return true;
+        }
+        stream::ConnectorInfo* next = NULL;
+        for (int i = 0; i < list->aliasCount; ++i) {
+            if (list->aliases[i].target == source->procBufUdata) {
+                next = list->aliases[i].source;
+                break;
+            }
+        }
+        source = next;
+    }
+    return false;
+}
+
+static bool hasAlias(stream::ProcList* list, ProcBufUserData* target)
+{
+    for (int i = 0; i < list->aliasCount; ++i) {
+        if (list->aliases[i].target == target) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * A stream buffer that is only written by one route aliases the route's 
+ * source buffer. Other writers of the stream buffer would modify the 
+ * source, in this case the route copies the data into the stream buffer.
+ * All other stream buffers of the list get an entry without source, so 
+ * that the realtime thread resets the alias of a buffer whose route was
+ * removed before the route's connector infos are used.
+ */
+static bool collectAliases(stream::ProcList* list)
+{
+    int connectorCount = 0;
+    for (int i = 0; i < list->count; ++i) {
+        connectorCount += list->regs[i]->connectorCount;
+    }
+    list->aliases = (stream::Alias*) calloc(connectorCount + 1, sizeof(stream::Alias));
+    if (!list->aliases) {
+        return false;
+    }
+    for (int i = 0; i < list->count; ++i) {
+        stream::ProcReg* reg = list->regs[i];
+        if (reg->processCallback != route::process) {
+            continue;
+        }
+        stream::ConnectorInfo* source = reg->connectorInfos + 0;
+        stream::ConnectorInfo* target = reg->connectorInfos + 1;
+        if (!target->isProcBuf) {
+            continue;
+        }
+        int writerCount = 0;
+        for (int j = 0; j < list->count; ++j) {
+            stream::ProcReg* r = list->regs[j];
+            for (int k = 0; k < r->connectorCount; ++k) {
+                stream::ConnectorInfo* info = r->connectorInfos + k;
+                if (info->isOutput && isSameConnector(info, target)) {
+                    writerCount += 1;
+                }
+            }
+        }
+        stream::Alias* a = list->aliases + list->aliasCount;
+        a->target = target->procBufUdata;
+        a->source = NULL;
+        if (writerCount == 1 && !isAliasOf(list, source, target->procBufUdata)) {
+            a->source = source;
+        }
+        list->aliasCount += 1;
+    }
+    for (int i = 0; i < list->count; ++i) {
+        stream::ProcReg* reg = list->regs[i];
+        for (int j = 0; j < reg->connectorCount; ++j) {
+            stream::ConnectorInfo* info = reg->connectorInfos + j;
+            if (info->isProcBuf && !hasAlias(list, info->procBufUdata)) {
+                stream::Alias* a = list->aliases + list->aliasCount;
+                a->target = info->procBufUdata;
+                a->source = NULL;
+                list->aliasCount += 1;
+            }
+        }
+    }
+    return true;
+}
+
+/* ============================================================================================ */
+
+static stream::MidiMerge* findMidiMerge(stream::ProcList* list, ProcBufUserData* target)
+{
+    for (int i = 0; i < list->midiMergeCount; ++i) {
+        if (list->midiMerges[i].target == target) {
+            return list->midiMerges + i;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * The sources of a MIDI stream buffer with writer slots are the buffer
+ * itself if a processor of the list writes it directly and the slots of
+ * the other writers.
+ */
+static bool collectMidiMerges(stream::ProcList* list)
 {
-    stream->activeProcRegList = newList;
+    int connectorCount = 0;
+    for (int i = 0; i < list->count; ++i) {
+        connectorCount += list->regs[i]->connectorCount;
+    }
+    list->midiMerges = (stream::MidiMerge*) calloc(connectorCount + 1, sizeof(stream::MidiMerge));
+    if (!list->midiMerges) {
+        return false;
+    }
+    for (int i = 0; i < list->count; ++i) {
+        stream::ProcReg* reg = list->regs[i];
+        for (int j = 0; j < reg->connectorCount; ++j) {
+            stream::ConnectorInfo* info = reg->connectorInfos + j;
+            if (info->slotMidi && !findMidiMerge(list, info->procBufUdata)) {
+                stream::MidiMerge* m = list->midiMerges + list->midiMergeCount++;
+                m->target = info->procBufUdata;
+            }
+        }
+    }
+    for (int i = 0; i < list->midiMergeCount; ++i) {
+        stream::MidiMerge* m = list->midiMerges + i;
+        m->sources = (ProcBufUserData**)   calloc(connectorCount + 1, sizeof(ProcBufUserData*));
+        m->cursors = (MidiEventRecord**) calloc(connectorCount + 1, sizeof(MidiEventRecord*));
+        if (!m->sources || !m->cursors) {
+            return false;
+        }
+        for (int pass = 0; pass < 2; ++pass) {
+            for (int j = 0; j < list->count; ++j) {
+                stream::ProcReg* reg = list->regs[j];
+                for (int k = 0; k < reg->connectorCount; ++k) {
+                    stream::ConnectorInfo* info = reg->connectorInfos + k;
+                    if (info->isOutput && info->procBufUdata == m->target) {
+                        if (pass == 0 && !info->slotMidi) {
+                            m->sources[m->sourceCount++] = m->target;
+                        }
+                        else if (pass == 1 && info->slotMidi) {
+                            m->sources[m->sourceCount++] = info->slotMidi;
+                        }
+                    }
+                }
+            }
+        }
+        size_t capacity = 0;
+        for (int j = 0; j < m->sourceCount; ++j) {
+            capacity += m->sources[j]->bufferLength / sizeof(MidiEventRecord);
+        }
+        m->merged = (MidiEventRecord**) calloc(capacity + 1, sizeof(MidiEventRecord*));
+        if (!m->merged) {
+            return false;
+        }
+        m->mergedCapacity = capacity;
+    }
+    return true;
+}
+
+/* ============================================================================================ */
+
+static bool collectChannels(stream::ProcList* list)
+{
+    int connectorCount = 0;
+    for (int i = 0; i < list->count; ++i) {
+        connectorCount += list->regs[i]->connectorCount;
+    }
+    list->channelIndexes = (int*) calloc(connectorCount + 1, sizeof(int));
+    if (!list->channelIndexes) {
+        return false;
+    }
+    for (int pass = 0; pass < 2; ++pass) {
+        bool  isInput = (pass == 0);
+        int   first   = list->inputChannelCount;
+        int*  count   = isInput ? &list->inputChannelCount : &list->outputChannelCount;
+        for (int i = 0; i < list->count; ++i) {
+            stream::ProcReg* reg = list->regs[i];
+            for (int j = 0; j < reg->connectorCount; ++j) {
+                stream::ConnectorInfo* info = reg->connectorInfos + j;
+                if (info->isChannel && info->channelUdata->isInput == isInput) {
+                    int index = info->channelUdata->index;
+                    if (index > 0 && !containsChannel(list->channelIndexes + first, *count, index)) {
+                        list->channelIndexes[first + (*count)++] = index;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/* ============================================================================================ */
+
+/**
+ * Builds a new list from oldList with addReg added and removeReg removed.
+ * The new list is scheduled in dependency order and contains the dependency
+ * graph for parallel processing. Returns NULL if out of memory.
+ */
+stream::ProcList* stream::new_proc_list(ProcList* oldList, ProcReg* addReg, ProcReg* removeReg)
+{
+    ProcList* list = (ProcList*) calloc(1, sizeof(ProcList));
+    if (!list) {
+        return NULL;
+    }
+    int n = 0;
+    if (oldList) {
+        n = oldList->count;
+    }
+    list->regs          = (ProcReg**)      calloc(n + 2, sizeof(ProcReg*));
+    list->activated     = (bool*)          calloc(n + 1, sizeof(bool));
+    list->predCounts    = (int*)           calloc(n + 1, sizeof(int));
+    list->succOffsets   = (int*)           calloc(n + 2, sizeof(int));
+    list->pendingCounts = (AtomicCounter*) calloc(n + 1, sizeof(AtomicCounter));
+    list->readySlots    = (AtomicCounter*) calloc(n + 1, sizeof(AtomicCounter));
+    int* levels         = (int*)           calloc(n + 1, sizeof(int));
+    int* levelWidths    = (int*)           calloc(n + 1, sizeof(int));
+    if (   !list->regs || !list->activated || !list->predCounts || !list->succOffsets
+        || !list->pendingCounts || !list->readySlots || !levels || !levelWidths)
+    {
+        if (levels)      free(levels);
+        if (levelWidths) free(levelWidths);
+        free_proc_list(list);
+        return NULL;
+    }
+    int count = 0;
+    for (int i = 0; i < n; ++i) {
+        if (oldList->regs[i] != removeReg) {
+            list->regs[count++] = oldList->regs[i];
+        }
+    }
+    if (addReg) {
+        list->regs[count++] = addReg;
+    }
+    list->regs[count] = NULL;
+    list->count = count;
     
-    if (stream->isRunning) {
-        while (   atomic_get(&stream->shutdownReceived) == 0
-               && stream->confirmedProcRegList != newList) 
-        {
-            async_mutex_wait(&stream->processMutex);
+    if (!scheduleProcList(list->regs, count)) {
+        free(levels);
+        free(levelWidths);
+        free_proc_list(list);
+        return NULL;
+    }
+    for (int i = 0; i < count; ++i) {
+        list->activated[i] = list->regs[i]->activated;
+    }
+    if (   !collectChannels(list) || !collectSumTargets(list) || !collectAliases(list)
+        || !collectMidiMerges(list)) 
+    {
+        free(levels);
+        free(levelWidths);
+        free_proc_list(list);
+        return NULL;
+    }
+    
+    // dependencies are only considered from earlier to later entries, i.e.
+    // edges that would close a dependency cycle are ignored.
+    int edgeCount = 0;
+    for (int j = 0; j < count; ++j) {
+        for (int i = 0; i < j; ++i) {
+            if (dependsOn(list->regs[j], list->regs[i])) {
+                list->predCounts[j] += 1;
+                edgeCount += 1;
+            }
+        }
+    }
+    list->succIndexes = (int*) calloc(edgeCount + 1, sizeof(int));
+    if (!list->succIndexes) {
+        free(levels);
+        free(levelWidths);
+        free_proc_list(list);
+        return NULL;
+    }
+    int e = 0;
+    for (int i = 0; i < count; ++i) {
+        list->succOffsets[i] = e;
+        for (int j = i + 1; j < count; ++j) {
+            if (dependsOn(list->regs[j], list->regs[i])) {
+                list->succIndexes[e++] = j;
+                if (levels[j] < levels[i] + 1) {
+                    levels[j] = levels[i] + 1;
+                }
+            }
+        }
+        levelWidths[levels[i]] += 1;
+        if (list->maxParallel < levelWidths[levels[i]]) {
+            list->maxParallel = levelWidths[levels[i]];
         }
     }
-    stream->confirmedProcRegList = newList;
+    list->succOffsets[count] = e;
+
+    free(levels);
+    free(levelWidths);
+    return list;
 }
 
 /* ============================================================================================ */
 
+void stream::free_proc_list(ProcList* list)
+{
+    if (list->regs)          free(list->regs);
+    if (list->activated)     free(list->activated);
+    if (list->channelIndexes) free(list->channelIndexes);
+    if (list->sumTargets)     free(list->sumTargets);
+    if (list->aliases)        free(list->aliases);
+    if (list->midiMerges) {
+        for (int i = 0; i < list->midiMergeCount; ++i) {
+            stream::MidiMerge* m = list->midiMerges + i;
+            if (m->sources) free(m->sources);
+            if (m->cursors) free(m->cursors);
+            if (m->merged)  free(m->merged);
+        }
+        free(list->midiMerges);
+    }
+    if (list->predCounts)    free(list->predCounts);
+    if (list->succOffsets)   free(list->succOffsets);
+    if (list->succIndexes)   free(list->succIndexes);
+    if (list->pendingCounts) free(list->pendingCounts);
+    if (list->readySlots)    free(list->readySlots);
+    free(list);
+}
+
+/* ============================================================================================ */
+
+void stream::begin_transaction(lua_State* L, Stream* stream)
+{
+    if (stream->inTransaction) {
+        luaL_error(L, "transaction already started");
+        return;
+    }
+    stream->inTransaction = true;
+}
 
+/* ============================================================================================ */
+
+void stream::commit_transaction(lua_State* L, Stream* stream)
+{
+    if (!stream->inTransaction) {
+        luaL_error(L, "no transaction started");
+        return;
+    }
+    ProcList* newList = new_proc_list(stream->procRegList, NULL, NULL);
+    if (!newList) {
+        luaL_error(L, "out of memory");
+        return;
+    }
+    if (stream->procRegList) {
+        for (int i = 0; i < stream->procRegList->count; ++i) {
+            ProcReg* reg = stream->procRegList->regs[i];
+            if (reg->hasPendingActivation) {
+                reg->activated            = reg->pendingActivated;
+                reg->hasPendingActivation = false;
+            }
+        }
+    }
+    for (int i = 0; i < newList->count; ++i) {
+        newList->activated[i] = newList->regs[i]->activated;
+    }
+    stream->inTransaction = false;
+    update_proc_list(stream, newList);
+}
+
+/* ============================================================================================ */
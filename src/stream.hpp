@@ -2,24 +2,24 @@
 #define LRTAUDIO_STREAM_HPP
 
 #include "util.h"
-
-/* ============================================================================================ */
-extern "C" {
-/* ============================================================================================ */
-
-struct receiver_capi;
-struct receiver_object;
-struct receiver_writer;
-
-/* ============================================================================================ */
-} // extern "C"
-/* ============================================================================================ */
+#include "stats.hpp"
+#include "auproc_capi.h"
 
 /* ============================================================================================ */
 namespace lrtaudio { 
 /* ============================================================================================ */
 
 struct ControllerUserData;
+struct WorkerPool;
+struct Route;
+struct Recorder;
+struct Player;
+struct MidiPort;
+struct Arena;
+struct EventRing;
+struct LogDrain;
+struct MidiEventRecord;
+struct VirtualDevice;
 
 /* ============================================================================================ */
 namespace stream {
@@ -42,6 +42,46 @@ struct ConnectorInfo
     
     ChannelUserData*  channelUdata;
     ProcBufUserData*  procBufUdata;
+    
+    float*            slotBuffer;  // own buffer if not the first writer of an audio output
+    uint32_t          slotFrames;
+    ProcBufUserData*  slotMidi;    // own buffer if not the first writer of a MIDI stream buffer
+};
+
+/**
+ * Stream buffer that is the target of a route and uses the buffer of the 
+ * route's source if the route is the only writer, source is NULL otherwise.
+ */
+struct Alias
+{
+    ProcBufUserData*  target;
+    ConnectorInfo*    source;
+};
+
+/**
+ * MIDI stream buffer that has additional writers. Readers of the target get
+ * the events of all sources merged by time. The merged list is built on the
+ * first read in a process cycle and refers to the events of the sources, 
+ * i.e. event data is not copied.
+ */
+struct MidiMerge
+{
+    ProcBufUserData*    target;
+    ProcBufUserData**   sources;        // target first if it has a direct writer, then writer slots
+    int                 sourceCount;
+    MidiEventRecord**   cursors;        // per source, only used while merging
+    MidiEventRecord**   merged;
+    uint32_t            mergedCapacity;
+};
+
+/**
+ * What happens if the process callback of a processor returns an error.
+ */
+enum ErrorPolicy
+{
+    ERROR_POLICY_STOP       = 0,  // stream is invalidated
+    ERROR_POLICY_DEACTIVATE = 1,  // processor is bypassed until activated again
+    ERROR_POLICY_RETRY      = 2   // processor is bypassed for a growing number of frames
 };
 
 struct ProcReg
@@ -53,14 +93,67 @@ struct ProcReg
     void (*engineClosedCallback)(void* processorData);
     void (*engineReleasedCallback)(void* processorData);      
     char* processorName;
+    uint32_t registrationNumber;
     uint32_t bufferFrames;
     uint32_t sampleRate;
     bool activated;
+    bool hasPendingActivation;  // activation change within transaction
+    bool pendingActivated;
     bool outBuffersCleared;
+    bool hasWriterSlots;
     int  connectorTableRef;
     int  connectorCount;
     ConnectorInfo* connectorInfos;
+    LoadStats      loadStats;
+    AtomicCounter  priority;        // processors with priority > 0 are never bypassed
+    AtomicCounter  bypassCount;     // number of cycles the processor was bypassed
+
+    AtomicCounter  errorPolicy;     // ErrorPolicy
+    AtomicCounter  retryFrames;     // initial backoff for ERROR_POLICY_RETRY
+    AtomicCounter  failed;          // set for ERROR_POLICY_DEACTIVATE
+    AtomicCounter  errorPending;    // error not yet reported
+    int            lastErrorCode;
+    int            failCount;       // consecutive errors
+    uint32_t       retryFrameTime;  // processor is bypassed until this frame time
+
+};
+
+/**
+ * Immutable list of registered processors in processing order. A new list 
+ * is built each time a processor is registered or unregistered. The list
+ * is published to the realtime thread by atomically replacing the pointer,
+ * the replaced list is retired and freed after the process cycle that 
+ * could still be using it has finished.
+ */
+struct ProcList
+{
+    int        count;
+    ProcReg**  regs;           // NULL terminated, in dependency order
+    bool*      activated;      // ProcReg::activated when the list was built
+    
+    int*       predCounts;     // number of processors that must be processed before regs[i]
+    int*       succOffsets;    // successors of regs[i] are succIndexes[succOffsets[i]..succOffsets[i+1]-1]
+    int*       succIndexes;
+    int        maxParallel;    // maximal number of processors that can be processed in parallel
 
+    int*       channelIndexes;      // stream channels used by the processors, inputs first
+    int        inputChannelCount;
+    int        outputChannelCount;
+    
+    ConnectorInfo** sumTargets;     // outputs with more than one writer, cleared at cycle start
+    int             sumTargetCount;
+
+    Alias*     aliases;             // applied by the realtime thread at cycle start
+    int        aliasCount;
+
+    MidiMerge* midiMerges;          // MIDI stream buffers with more than one writer
+    int        midiMergeCount;
+
+    AtomicCounter* pendingCounts; // per cycle state for parallel processing
+    AtomicCounter* readySlots;    // per cycle state for parallel processing
+
+    ProcList*  nextRetired;
+    int        retiredEpoch;   // value of Stream::processEpoch when the list was replaced
 };
 
 /* ============================================================================================ */
@@ -78,29 +171,59 @@ struct Stream
     uint32_t       bufferFrames;
     uint32_t       sampleRate;
     unsigned int   numberOfBuffers; // TODO ???
+
+    RtAudioFormat  sampleFormat;
+    bool           interleaved;
+    bool           convertSamples;        // device buffers are not non-interleaved float
+    float*         inputChannelBuffers;   // float buffers for used channels if convertSamples
+    float*         outputChannelBuffers;
     
-    Mutex          processMutex;
+    Arena*         arena;                 // memory for all buffers used in the process cycle
 
-    const receiver_capi* statusReceiverCapi;
-    receiver_object*     statusReceiver;
-    receiver_writer*     statusWriter;
+    EventRing*     statusEvents;          // NULL if there is no status receiver
+    LogDrain*      logDrain;              // delivers log messages from the realtime threads
 
     bool           isOpen;
     bool           isRunning;
+    bool           isOffline;             // no device, process cycles are invoked by render_offline
+    VirtualDevice* virtualDevice;         // invokes process cycles of an offline stream in real time
     AtomicCounter  shutdownReceived;
     AtomicCounter  severeProcessingError;
 
-    stream::ProcReg**  procRegList;
-    int                procRegCount;
-    stream::ProcReg**  activeProcRegList;
-    stream::ProcReg**  confirmedProcRegList;
+    stream::ProcList*  procRegList;
+    uint32_t           procRegCounter;
+    AtomicPtr          activeProcRegList;
+    AtomicCounter      processEpoch;          // odd while realtime thread is in process cycle
+    stream::ProcList*  processList;           // list of the current process cycle
+    AtomicPtr          pendingMidiResize;     // MidiResize applied at begin of next process cycle
+    stream::ProcList*  retiredProcRegLists;
+    bool               inTransaction;
+    
+    WorkerPool*        workerPool;
+    AtomicPtr          errorProcReg;
+    AtomicCounter      errorReturnCode;
+
+    AtomicCounter      measureLoad;           // timestamp processors and process cycle
+    LoadStats          cycleStats;
+    XrunStats          xrunStats;
+
+    AtomicCounter      cycleBudgetMicros;     // 0: no processing time budget
+    uint64_t           cycleDeadline;         // monotonic nanos, 0 if no budget in current cycle
+    AtomicCounter      bypassedCount;         // processors bypassed in current cycle
+    AtomicCounter      degradedCycles;        // cycles with bypassed processors
+    AtomicCounter      recoveredErrorCount;   // non-fatal processor errors in current cycle
 
     uint32_t          processBeginFrameTime;
+    uint64_t          processBeginNanos;      // monotonic time at begin of current cycle
     void*             currentOutputBuffers;
     void*             currentInputBuffers;
     
     ChannelUserData*  firstChannelUserData;
     ProcBufUserData*  firstProcBufUserData;
+    Route*            firstRoute;
+    Recorder*         firstRecorder;
+    Player*           firstPlayer;
+    MidiPort*         firstMidiPort;
 };
 
 /* ============================================================================================ */
@@ -109,10 +232,27 @@ namespace stream {
 
 int open_stream(lua_State* L, ControllerUserData* udata, 
                 uint32_t sampleRate, uint32_t bufferFrames,
+                RtAudioFormat sampleFormat, int workerThreads, bool hugePages,
                 RtAudio::StreamOptions*    options,
                 RtAudio::StreamParameters* outParams,
                 RtAudio::StreamParameters* inpParams);
                     
+/**
+ * Opens a stream without audio device. The channel buffers are silent
+ * inputs and outputs that are only visible to the processors.
+ */
+int open_offline_stream(lua_State* L, ControllerUserData* udata, 
+                        uint32_t sampleRate, uint32_t bufferFrames,
+                        int inputChannels, int outputChannels,
+                        int workerThreads, bool hugePages);
+
+/**
+ * Invokes process cycles of an offline stream until at least nframes
+ * frames are processed or a processing error occurs. Returns the number 
+ * of processed frames.
+ */
+uint32_t render_offline(Stream* stream, uint32_t nframes);
+
 void close_stream(ControllerUserData* udata);
 
 void release_stream(lua_State* L, ControllerUserData* udata);
@@ -125,8 +265,75 @@ void handle_shutdown(ControllerUserData* udata);
 
 void check_not_closed(lua_State* L, ControllerUserData* udata);
 
-void activate_proc_list_LOCKED(Stream*    stream, 
-                               ProcReg**  newList);
+/**
+ * Makes newList the current list of registered processors. The list is
+ * published immediately, or on commit_transaction if a transaction
+ * has been started.
+ */
+void update_proc_list(Stream* stream, ProcList* newList);
+
+/**
+ * Publishes newList to the realtime thread without waiting. The 
+ * previously published list is retired.
+ */
+void publish_proc_list(Stream* stream, ProcList* newList);
+
+bool is_published(Stream* stream, ProcReg* reg);
+
+/**
+ * Frees retired lists that are no longer used by the realtime thread.
+ * If waitForRealtime is true, waits until the process cycle that may
+ * still be using a retired list has finished, i.e. after this call no
+ * previously published list is referenced by the realtime thread.
+ */
+void reclaim_proc_lists(Stream* stream, bool waitForRealtime);
+
+/**
+ * Builds a new list from oldList with addReg added and removeReg removed.
+ * Both may be NULL. Returns NULL if out of memory.
+ */
+ProcList* new_proc_list(ProcList* oldList, ProcReg* addReg, ProcReg* removeReg);
+
+void free_proc_list(ProcList* list);
+
+/**
+ * Invokes the processor if activated, otherwise clears its outputs. An
+ * activated processor is bypassed like an inactive one if the deadline 
+ * of the current cycle has passed and its priority is not above zero,
+ * or if it is bypassed because of its error policy. Returns the error
+ * code of the processor if the stream has to be invalidated.
+ */
+int process_reg(Stream* stream, ProcReg* reg, bool activated, uint32_t nframes);
+
+/**
+ * Sets the priority of all registered processors with the given name. 
+ * Returns the number of processors found.
+ */
+int set_processor_priority(Stream* stream, const char* processorName, int priority);
+
+/**
+ * Sets the error policy of all registered processors with the given name.
+ * retryFrames is the initial backoff for ERROR_POLICY_RETRY, it is doubled 
+ * with each consecutive error. Returns the number of processors found.
+ */
+int set_processor_error_policy(Stream* stream, const char* processorName, 
+                               ErrorPolicy policy, uint32_t retryFrames);
+
+/**
+ * Clears the outputs that are summed from more than one writer.
+ * Must be called at the beginning of the process cycle.
+ */
+void clear_sum_targets(Stream* stream, ProcList* list, uint32_t nframes);
+
+/**
+ * Sets the alias of each route target in the list. Must be called
+ * by the realtime thread at the beginning of the process cycle.
+ */
+void apply_aliases(ProcList* list);
+
+void begin_transaction(lua_State* L, Stream* stream);
+
+void commit_transaction(lua_State* L, Stream* stream);
                                
 
 /* ============================================================================================ */
@@ -22,6 +22,14 @@
     #include <sys/timeb.h>
 #else
     #include <sys/time.h>
+    #include <sys/mman.h> /* before visibility pragma, see below */
+    #include <sys/stat.h>
+    #include <fcntl.h>
+#endif
+
+#if defined(LRTAUDIO_USE_ALSA_MIDI)
+    #include <poll.h>
+    #include <alsa/asoundlib.h> /* before visibility pragma, see below */
 #endif
 
 #if defined(__cplusplus)
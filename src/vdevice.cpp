@@ -0,0 +1,164 @@
+#include "main.hpp"
+#include "controller.hpp"
+#include "stream.hpp"
+#include "vdevice.hpp"
+
+#if defined(LRTAUDIO_ASYNC_USE_PTHREAD)
+    #include <sched.h>
+#endif
+
+using namespace lrtaudio;
+
+/* ============================================================================================ */
+
+static void setupTimerThread(VirtualDevice* device)
+{
+    if (device->realtimePriority < 0) {
+        return;
+    }
+#if defined(LRTAUDIO_ASYNC_USE_PTHREAD)
+    struct sched_param param;
+    int min = sched_get_priority_min(SCHED_RR);
+    int max = sched_get_priority_max(SCHED_RR);
+    int prio = device->realtimePriority;
+    if      (prio < min) prio = min;
+    else if (prio > max) prio = max;
+    param.sched_priority = prio;
+    if (pthread_setschedparam(pthread_self(), SCHED_RR, &param) != 0) {
+        lrtaudio::log_info("lrtaudio: cannot set realtime scheduling for virtual device");
+    }
+#elif defined(LRTAUDIO_ASYNC_USE_WINTHREAD)
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#endif
+}
+
+/* ============================================================================================ */
+
+static void sleepUntil(uint64_t nanos)
+{
+    uint64_t now = async_monotonic_nanos();
+    if (nanos <= now) {
+        return;
+    }
+    uint64_t delta = nanos - now;
+#if defined(LRTAUDIO_ASYNC_USE_WINTHREAD)
+    Sleep((DWORD)(delta / 1000000));
+#else
+    struct timespec t;
+    t.tv_sec  = delta / 1000000000;
+    t.tv_nsec = delta % 1000000000;
+    while (nanosleep(&t, &t) != 0 && errno == EINTR) {}
+#endif
+}
+
+/* ============================================================================================ */
+
+static uint32_t nextRandom(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/* ============================================================================================ */
+
+static void timerMain(void* arg)
+{
+    VirtualDevice* device = (VirtualDevice*) arg;
+    Stream*        stream = device->stream;
+
+    setupTimerThread(device);
+
+    uint64_t period = (uint64_t)stream->bufferFrames * 1000000000 / stream->sampleRate;
+    uint64_t jitter = (uint64_t)(device->jitter * 1e9);
+    uint32_t random = 2463534242u;
+    uint64_t next   = async_monotonic_nanos() + period;
+
+    while (!atomic_get(&device->shutdown))
+    {
+        uint64_t delay = jitter > 0 ? (uint64_t)((double)nextRandom(&random) / 4294967296.0 * jitter) : 0;
+        sleepUntil(next + delay);
+
+        RtAudioStreamStatus status = 0;
+        uint64_t            now    = async_monotonic_nanos();
+        if (now > next + period) {
+            status = RTAUDIO_OUTPUT_UNDERFLOW;
+            next   = now; // resynchronize after missed cycles
+        }
+        double streamTime = (double)stream->processBeginFrameTime / stream->sampleRate;
+        int rc = stream::rtaudio_callback(stream->outputChannelBuffers, stream->inputChannelBuffers,
+                                          stream->bufferFrames, streamTime, status, stream);
+        if (rc != 0) {
+            break;
+        }
+        next += period;
+    }
+}
+
+/* ============================================================================================ */
+
+void vdevice::get_device_info(RtAudio::DeviceInfo* deviceInfo)
+{
+    static const unsigned int sampleRates[] = { 44100, 48000, 88200, 96000, 192000 };
+
+    deviceInfo->name                = "lrtaudio virtual device";
+    deviceInfo->outputChannels      = CHANNELS;
+    deviceInfo->inputChannels       = CHANNELS;
+    deviceInfo->duplexChannels      = CHANNELS;
+    deviceInfo->isDefaultOutput     = false;
+    deviceInfo->isDefaultInput      = false;
+    deviceInfo->preferredSampleRate = SAMPLE_RATE;
+    deviceInfo->nativeFormats       = RTAUDIO_FLOAT32;
+    deviceInfo->sampleRates.assign(sampleRates, sampleRates + sizeof(sampleRates)/sizeof(sampleRates[0]));
+#if !LRTAUDIO_NEW_RTAUDIO
+    deviceInfo->probed              = true;
+#endif
+}
+
+/* ============================================================================================ */
+
+VirtualDevice* vdevice::new_virtual_device(Stream* stream, double jitter, int realtimePriority)
+{
+    VirtualDevice* device = (VirtualDevice*) calloc(1, sizeof(VirtualDevice));
+    if (device) {
+        device->stream           = stream;
+        device->jitter           = jitter;
+        device->realtimePriority = realtimePriority;
+    }
+    return device;
+}
+
+/* ============================================================================================ */
+
+void vdevice::free_virtual_device(VirtualDevice* device)
+{
+    vdevice::stop(device);
+    free(device);
+}
+
+/* ============================================================================================ */
+
+bool vdevice::start(VirtualDevice* device)
+{
+    if (!device->started) {
+        atomic_set(&device->shutdown, 0);
+        device->started = async_thread_start(&device->thread, timerMain, device);
+    }
+    return device->started;
+}
+
+/* ============================================================================================ */
+
+void vdevice::stop(VirtualDevice* device)
+{
+    if (device->started) {
+        atomic_set(&device->shutdown, 1);
+        async_thread_join(&device->thread);
+        device->started = false;
+    }
+}
+
+/* ============================================================================================ */
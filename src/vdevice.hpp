@@ -0,0 +1,58 @@
+#ifndef LRTAUDIO_VDEVICE_HPP
+#define LRTAUDIO_VDEVICE_HPP
+
+#include "util.h"
+
+/* ============================================================================================ */
+namespace lrtaudio {
+/* ============================================================================================ */
+
+struct Stream;
+
+/**
+ * Built-in device without sound hardware: a timer thread invokes the
+ * process cycles of an offline stream in real time. Each cycle can be
+ * delayed by a random jitter. Cycles that are started later than one
+ * period after their scheduled time are reported as output underflow.
+ */
+struct VirtualDevice
+{
+    Stream*        stream;
+    double         jitter;            // maximal random delay of a cycle in seconds
+    int            realtimePriority;  // no realtime scheduling if < 0
+    Thread         thread;
+    bool           started;
+    AtomicCounter  shutdown;
+};
+
+/* ============================================================================================ */
+namespace vdevice {
+/* ============================================================================================ */
+
+static const int CHANNELS     = 32;
+static const int SAMPLE_RATE  = 48000;
+
+/**
+ * Fills deviceInfo with the properties of the virtual device.
+ */
+void get_device_info(RtAudio::DeviceInfo* deviceInfo);
+
+VirtualDevice* new_virtual_device(Stream* stream, double jitter, int realtimePriority);
+
+void free_virtual_device(VirtualDevice* device);
+
+/**
+ * Returns false if the timer thread could not be started.
+ */
+bool start(VirtualDevice* device);
+
+/**
+ * Waits until the timer thread has finished.
+ */
+void stop(VirtualDevice* device);
+
+/* ============================================================================================ */
+} } // namespace lrtaudio::vdevice
+/* ============================================================================================ */
+
+#endif // LRTAUDIO_VDEVICE_HPP
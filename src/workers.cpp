@@ -0,0 +1,315 @@
+#include "main.hpp"
+#include "controller.hpp"
+#include "stream.hpp"
+#include "workers.hpp"
+
+#if defined(LRTAUDIO_ASYNC_USE_PTHREAD)
+    #include <sched.h>
+#endif
+
+using namespace lrtaudio;
+using stream::ProcList;
+using stream::ProcReg;
+
+/* ============================================================================================ */
+
+struct lrtaudio::WorkerThread
+{
+    WorkerPool* pool;
+    int         index;
+    int         realtimePriority;  // currently applied, -1 if none
+    Thread      thread;
+    bool        started;
+};
+
+/* ============================================================================================ */
+
+/**
+ * Number of async_cpu_relax() calls before a thread that waits for other 
+ * threads within a process cycle stops spinning.
+ */
+static const int SPIN_LIMIT = 1000;
+
+/* ============================================================================================ */
+
+/**
+ * Returns the realtime priority of the calling thread or -1 if the
+ * thread is not scheduled as realtime thread.
+ */
+static int getRealtimePriority()
+{
+#if defined(LRTAUDIO_ASYNC_USE_PTHREAD)
+    int                policy;
+    struct sched_param param;
+    if (   pthread_getschedparam(pthread_self(), &policy, &param) == 0
+        && (policy == SCHED_FIFO || policy == SCHED_RR))
+    {
+        return param.sched_priority;
+    }
+#elif defined(LRTAUDIO_ASYNC_USE_WINTHREAD)
+    if (GetThreadPriority(GetCurrentThread()) == THREAD_PRIORITY_TIME_CRITICAL) {
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+/* ============================================================================================ */
+
+static void setRealtimePriority(WorkerThread* w, int prio)
+{
+    w->realtimePriority = prio;
+#if defined(LRTAUDIO_ASYNC_USE_PTHREAD)
+    struct sched_param param;
+    int min = sched_get_priority_min(SCHED_RR);
+    int max = sched_get_priority_max(SCHED_RR);
+    if      (prio < min) prio = min;
+    else if (prio > max) prio = max;
+    param.sched_priority = prio;
+    if (pthread_setschedparam(pthread_self(), SCHED_RR, &param) != 0) {
+        lrtaudio::log_info("lrtaudio: cannot set realtime scheduling for worker thread %d", w->index + 1);
+    }
+#elif defined(LRTAUDIO_ASYNC_USE_WINTHREAD)
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#endif
+}
+
+/* ============================================================================================ */
+
+static void pushReady(WorkerPool* pool, ProcList* list, int index)
+{
+    int slot = atomic_inc(&pool->readyTail) - 1;
+    atomic_set(list->readySlots + slot, index);
+}
+
+/* ============================================================================================ */
+
+/**
+ * Invoked by a worker after it has made progress the realtime thread 
+ * may be waiting for.
+ */
+static void notifyProgress(WorkerPool* pool)
+{
+    if (atomic_get(&pool->waiting) && atomic_set_if_equal(&pool->waiting, 1, 0)) {
+        async_sem_post(&pool->progress);
+    }
+}
+
+/**
+ * Blocks the realtime thread until a worker invokes notifyProgress. Returns
+ * immediately if hasProgress became true while the wait was prepared.
+ */
+static void waitForProgress(WorkerPool* pool, bool (*hasProgress)(WorkerPool*))
+{
+    atomic_set(&pool->waiting, 1);
+    if (hasProgress(pool) && atomic_set_if_equal(&pool->waiting, 1, 0)) {
+        return;
+    }
+    async_sem_wait(&pool->progress);
+}
+
+static bool hasReadyOrFinished(WorkerPool* pool)
+{
+    return atomic_get(&pool->readyHead) < atomic_get(&pool->readyTail)
+        || atomic_get(&pool->remaining) == 0;
+}
+
+static bool hasNoActiveWorker(WorkerPool* pool)
+{
+    return atomic_get(&pool->activeCount) == 0;
+}
+
+/* ============================================================================================ */
+
+static void processNode(WorkerPool* pool, ProcList* list, int index)
+{
+    Stream*  stream = pool->stream;
+    ProcReg* reg    = list->regs[index];
+
+    int rc = stream::process_reg(stream, reg, list->activated[index], pool->nframes);
+    if (rc != 0) {
+        if (atomic_set_ptr_if_equal(&stream->errorProcReg, NULL, reg)) {
+            atomic_set(&stream->errorReturnCode, rc);
+        }
+    }
+    for (int j = list->succOffsets[index], n = list->succOffsets[index + 1]; j < n; ++j) {
+        int succ = list->succIndexes[j];
+        if (atomic_dec(list->pendingCounts + succ) == 0) {
+            pushReady(pool, list, succ);
+        }
+    }
+    atomic_dec(&pool->remaining);
+}
+
+/* ============================================================================================ */
+
+/**
+ * Processes ready nodes until all nodes of the cycle are finished. A worker
+ * returns earlier if no node became ready within SPIN_LIMIT, the realtime 
+ * thread then blocks instead, so that a preempted worker holding a node 
+ * cannot be starved by spinning threads.
+ */
+static void participate(WorkerPool* pool, bool isWorker)
+{
+    ProcList* list = pool->list;
+    int       idle = 0;
+
+    while (atomic_get(&pool->remaining) > 0)
+    {
+        int head = atomic_get(&pool->readyHead);
+        if (   head < atomic_get(&pool->readyTail)
+            && atomic_set_if_equal(&pool->readyHead, head, head + 1))
+        {
+            int index;
+            while ((index = atomic_get(list->readySlots + head)) < 0) {
+                async_cpu_relax(); // slot reserved but not yet written
+            }
+            processNode(pool, list, index);
+            if (isWorker) {
+                notifyProgress(pool);
+            }
+            idle = 0;
+        } 
+        else if (++idle < SPIN_LIMIT) {
+            async_cpu_relax();
+        } 
+        else if (isWorker) {
+            break;
+        } 
+        else {
+            waitForProgress(pool, hasReadyOrFinished);
+            idle = 0;
+        }
+    }
+}
+
+/* ============================================================================================ */
+
+static void workerMain(void* arg)
+{
+    WorkerThread* w    = (WorkerThread*) arg;
+    WorkerPool*   pool = w->pool;
+
+    if (w->realtimePriority >= 0) {
+        setRealtimePriority(w, w->realtimePriority);
+    }
+    while (true) {
+        async_sem_wait(&pool->wakeup);
+        if (atomic_get(&pool->shutdown)) {
+            break;
+        }
+        int callerPriority = atomic_get(&pool->callerPriority);
+        if (callerPriority > w->realtimePriority) {
+            setRealtimePriority(w, callerPriority); // not below the audio thread
+        }
+        participate(pool, true);
+        atomic_dec(&pool->activeCount);
+        notifyProgress(pool);
+    }
+}
+
+/* ============================================================================================ */
+
+WorkerPool* workers::new_worker_pool(Stream* stream, int threadCount, int realtimePriority)
+{
+    WorkerPool*   pool    = (WorkerPool*)   calloc(1, sizeof(WorkerPool));
+    WorkerThread* threads = (WorkerThread*) calloc(threadCount, sizeof(WorkerThread));
+    if (!pool || !threads) {
+        if (pool)    free(pool);
+        if (threads) free(threads);
+        return NULL;
+    }
+    pool->stream      = stream;
+    pool->threadCount = threadCount;
+    pool->threads     = threads;
+    async_sem_init(&pool->wakeup);
+    async_sem_init(&pool->progress);
+    atomic_set(&pool->callerPriority, -1);
+
+    for (int i = 0; i < threadCount; ++i) {
+        WorkerThread* w = threads + i;
+        w->pool             = pool;
+        w->index            = i;
+        w->realtimePriority = realtimePriority;
+        w->started = async_thread_start(&w->thread, workerMain, w);
+        if (!w->started) {
+            workers::free_worker_pool(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+/* ============================================================================================ */
+
+void workers::free_worker_pool(WorkerPool* pool)
+{
+    atomic_set(&pool->shutdown, 1);
+    for (int i = 0; i < pool->threadCount; ++i) {
+        async_sem_post(&pool->wakeup);
+    }
+    for (int i = 0; i < pool->threadCount; ++i) {
+        if (pool->threads[i].started) {
+            async_thread_join(&pool->threads[i].thread);
+        }
+    }
+    async_sem_destruct(&pool->wakeup);
+    async_sem_destruct(&pool->progress);
+    free(pool->threads);
+    free(pool);
+}
+
+/* ============================================================================================ */
+
+void workers::process_parallel(WorkerPool* pool, ProcList* list, uint32_t nframes)
+{
+    int n = list->count;
+
+    pool->list    = list;
+    pool->nframes = nframes;
+
+    if (!pool->callerChecked) {
+        pool->callerChecked = true;
+        atomic_set(&pool->callerPriority, getRealtimePriority());
+    }
+
+    // no worker is active at this point, so plain stores are sufficient here,
+    // the following atomic operations and the semaphore are memory barriers.
+    for (int i = 0; i < n; ++i) {
+        list->pendingCounts[i] = list->predCounts[i];
+        list->readySlots[i]    = -1;
+    }
+    atomic_set(&pool->readyHead, 0);
+    atomic_set(&pool->readyTail, 0);
+    atomic_set(&pool->remaining, n);
+
+    for (int i = 0; i < n; ++i) {
+        if (list->predCounts[i] == 0) {
+            pushReady(pool, list, i);
+        }
+    }
+    int wakeCount = list->maxParallel - 1;
+    if (wakeCount > pool->threadCount) {
+        wakeCount = pool->threadCount;
+    }
+    atomic_set(&pool->activeCount, wakeCount);
+    for (int i = 0; i < wakeCount; ++i) {
+        async_sem_post(&pool->wakeup);
+    }
+
+    participate(pool, false);
+
+    // take back wakeups that were not consumed by a worker
+    for (int i = 0; i < wakeCount && async_sem_trywait(&pool->wakeup); ++i) {
+        atomic_dec(&pool->activeCount);
+    }
+    for (int idle = 0; atomic_get(&pool->activeCount) > 0; ++idle) {
+        if (idle < SPIN_LIMIT) {
+            async_cpu_relax();
+        } else {
+            waitForProgress(pool, hasNoActiveWorker);
+        }
+    }
+}
+
+/* ============================================================================================ */
@@ -0,0 +1,67 @@
+#ifndef LRTAUDIO_WORKERS_HPP
+#define LRTAUDIO_WORKERS_HPP
+
+#include "util.h"
+
+/* ============================================================================================ */
+namespace lrtaudio {
+/* ============================================================================================ */
+
+struct Stream;
+
+namespace stream {
+    struct ProcList;
+}
+
+struct WorkerThread;
+
+/**
+ * Pre-spawned threads for processing independent processors of one
+ * process cycle in parallel. The realtime thread that invokes the
+ * process cycle participates in processing and waits until all
+ * processors of the cycle are finished. Waiting threads spin only for
+ * a short time: workers then leave the cycle and the realtime thread 
+ * blocks until a worker reports progress.
+ */
+struct WorkerPool
+{
+    Stream*        stream;
+    int            threadCount;
+    WorkerThread*  threads;
+    Semaphore      wakeup;
+    AtomicCounter  shutdown;
+    AtomicCounter  activeCount;
+    Semaphore      progress;          // posted for the realtime thread if waiting is set
+    AtomicCounter  waiting;
+    AtomicCounter  callerPriority;    // realtime priority of the process cycle thread, -1 if none
+    bool           callerChecked;     // only used by the process cycle thread
+
+    stream::ProcList* list;
+    uint32_t          nframes;
+    AtomicCounter     readyHead;
+    AtomicCounter     readyTail;
+    AtomicCounter     remaining;
+};
+
+/* ============================================================================================ */
+namespace workers {
+/* ============================================================================================ */
+
+/**
+ * realtimePriority - scheduling priority for the worker threads,
+ *                    no realtime scheduling is requested if < 0.
+ */
+WorkerPool* new_worker_pool(Stream* stream, int threadCount, int realtimePriority);
+
+void free_worker_pool(WorkerPool* pool);
+
+/**
+ * Must only be called from the realtime thread.
+ */
+void process_parallel(WorkerPool* pool, stream::ProcList* list, uint32_t nframes);
+
+/* ============================================================================================ */
+} } // namespace lrtaudio::workers
+/* ============================================================================================ */
+
+#endif // LRTAUDIO_WORKERS_HPP